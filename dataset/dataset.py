@@ -2,10 +2,13 @@ import ast
 import json
 import re
 import sys
+from functools import lru_cache
 
 # import torch
 from torch.utils.data import Dataset
 
+from make_trace.sink import RecordFile
+
 # from pathlib import Path
 
 
@@ -27,17 +30,51 @@ def replace_indices_with_APs(line: str, aps: list[str]) -> str:
     )
 
 
+@lru_cache(maxsize=1 << 16)
+def transition_sentence(line: str, aps: tuple) -> str:
+    """Turn one hoax line into its NL transition.
+
+    Transcripts of the same system repeat the same lines over and over, so each
+    distinct line is only parsed once.
+    """
+    _, tup_str = line.split(":", 1)
+    start, inputs, nxt = ast.literal_eval(tup_str.strip())
+    inputs_list = sorted(list(inputs))  # stable order
+    inputs_list_named = [
+        aps[int(ap.split("_")[-1])] if ap.isdigit() else ap for ap in inputs_list
+    ]
+    if inputs_list_named:
+        inputs_str = " and ".join(inputs_list)
+    else:
+        inputs_str = "no inputs"
+    return (
+        f"From state {start}, "
+        f"on inputs {inputs_str}, "
+        f"the automaton moves to state {nxt}."
+    )
+
+
 class TempoBench_Dataset(Dataset):
     def __init__(self, path, tokenizer=None, task="trace_acceptance"):
-        self.data = []
         self.task = task
         self.tokenizer = tokenizer
 
-        with open(path, "r") as f:
-            for line in f:
-                item = json.loads(line)
-                if item.get("error") is None:  # skip failed runs
-                    self.data.append(item)
+        # Records stay on disk (memory-mapped, see RecordFile) and are parsed on
+        # access; only the indices of successful runs are kept in memory.
+        self.records = RecordFile(path)
+        self.items = self.records.ok()  # skip failed runs
+
+        # AP-substituted HOA of each distinct system, shared by all of its runs.
+        self.pretty_hoas = {}
+
+    def pretty_hoa(self, result: dict):
+        hoa = result["hoa"]
+        if hoa not in self.pretty_hoas:
+            self.pretty_hoas[hoa] = "\n".join(
+                replace_indices_with_APs(line, result["aps"])
+                for line in hoa.splitlines()
+            )
+        return self.pretty_hoas[hoa]
 
     def construct_acceptance_trace(self, result: dict):
         """Read in hoax and hoa to construct a NL version of the trace.
@@ -46,28 +83,13 @@ class TempoBench_Dataset(Dataset):
         hoa:  full HOA string
         """
         # hoa = result["hoa"]
-        aps = result["aps"]
+        aps = tuple(result["aps"])
         hoax = result["hoax"]
 
         # TODO extract the state rules for each state from the hoa
-        nl_transitions = []
-        for line in hoax.strip().split("\n"):
-            _, tup_str = line.split(":", 1)
-            start, inputs, nxt = ast.literal_eval(tup_str.strip())
-            inputs_list = sorted(list(inputs))  # stable order
-            inputs_list_named = [
-                aps[int(ap.split("_")[-1])] if ap.isdigit() else ap
-                for ap in inputs_list
-            ]
-            if inputs_list_named:
-                inputs_str = " and ".join(inputs_list)
-            else:
-                inputs_str = "no inputs"
-            nl_transitions.append(
-                f"From state {start}, "
-                f"on inputs {inputs_str}, "
-                f"the automaton moves to state {nxt}."
-            )
+        nl_transitions = [
+            transition_sentence(line, aps) for line in hoax.strip().split("\n")
+        ]
 
         prompt = (
             "These are the corresponding state transitions to the automaton:\n\n"
@@ -76,17 +98,13 @@ class TempoBench_Dataset(Dataset):
         return prompt
 
     def __len__(self):
-        return len(self.data)
+        return len(self.items)
 
     def __getitem__(self, idx):
-        result = self.data[idx]["result"]
+        result = self.records[int(self.items[idx])]["result"]
 
         if self.task == "trace_acceptance":
-            aps = result["aps"]
-            hoa_pretty = "\n".join(
-                replace_indices_with_APs(line, aps)
-                for line in result["hoa"].splitlines()
-            )
+            hoa_pretty = self.pretty_hoa(result)
             prompt = (
                 f"You are given an automaton (HOA format) with APs {result['aps']}.\n\n"
                 f"Automaton:\n{hoa_pretty}\n\n"
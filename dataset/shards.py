@@ -0,0 +1,145 @@
+"""Offline tokenization of a run_parallel output into length-bucketed shards.
+
+Each shard of a task consists of
+- <task>-<shard>.tokens.bin: all prompt and label token ids as one flat int32 array,
+- <task>-<shard>.index.npy: one (bucket, prompt_start, prompt_len, label_start,
+  label_len) row per sample, sorted by bucket,
+- <task>-<shard>.json: the sample/token counts and the row range of each bucket.
+
+Both arrays are memory-mapped by TokenShard, so a training rank reads its shard
+without copies or per-sample Python work. Samples are bucketed by the power of two
+above their total length and spread round-robin over the shards within each bucket,
+so that every shard gets the same mix of lengths.
+"""
+
+import json
+import sys
+from pathlib import Path
+
+import numpy as np
+
+from .dataset import TempoBench_Dataset
+
+TASKS = ("trace_acceptance", "causality")
+# Samples are tokenized in batches of this size.
+BATCH_SIZE = 1024
+
+
+def shard_paths(out_dir, task, shard):
+    base = Path(out_dir) / f"{task}-{shard:05d}"
+    return (
+        Path(f"{base}.tokens.bin"),
+        Path(f"{base}.index.npy"),
+        Path(f"{base}.json"),
+    )
+
+
+def bucket_of(length):
+    """Returns the length bucket of a sample: the exponent of the next power of
+    two."""
+    return max(0, (length - 1).bit_length())
+
+
+def export(path, tokenizer, out_dir, task="trace_acceptance", num_shards=1):
+    """Tokenizes every successful run of a data file for one task into num_shards
+    shards below out_dir."""
+    out_dir = Path(out_dir)
+    out_dir.mkdir(parents=True, exist_ok=True)
+    ds = TempoBench_Dataset(path, tokenizer=None, task=task)
+
+    files = [open(shard_paths(out_dir, task, k)[0], "wb") for k in range(num_shards)]
+    rows = [[] for _ in range(num_shards)]
+    offsets = [0] * num_shards
+    # Next shard of each bucket, for the round-robin assignment.
+    turn = {}
+
+    try:
+        for lo in range(0, len(ds), BATCH_SIZE):
+            samples = [ds[i] for i in range(lo, min(lo + BATCH_SIZE, len(ds)))]
+            prompts = tokenizer([p for p, _ in samples], truncation=True)
+            labels = tokenizer([label for _, label in samples])
+            for prompt, label in zip(prompts["input_ids"], labels["input_ids"]):
+                bucket = bucket_of(len(prompt) + len(label))
+                k = turn.get(bucket, 0)
+                turn[bucket] = (k + 1) % num_shards
+
+                tokens = np.asarray(prompt + label, dtype=np.int32)
+                files[k].write(tokens.tobytes())
+                start = offsets[k]
+                rows[k].append(
+                    (bucket, start, len(prompt), start + len(prompt), len(label))
+                )
+                offsets[k] += len(tokens)
+    finally:
+        for f in files:
+            f.close()
+
+    for k in range(num_shards):
+        _, index_path, meta_path = shard_paths(out_dir, task, k)
+        index = np.array(rows[k], dtype=np.int64).reshape(-1, 5)
+        index = index[np.argsort(index[:, 0], kind="stable")]
+        np.save(index_path, index)
+
+        buckets = {}
+        for bucket in np.unique(index[:, 0]):
+            hits = np.flatnonzero(index[:, 0] == bucket)
+            buckets[int(bucket)] = [int(hits[0]), int(hits[-1]) + 1]
+        meta = {
+            "task": task,
+            "shard": k,
+            "num_shards": num_shards,
+            "num_samples": len(index),
+            "num_tokens": offsets[k],
+            "dtype": "int32",
+            "tokenizer": getattr(tokenizer, "name_or_path", None),
+            "buckets": buckets,
+        }
+        meta_path.write_text(json.dumps(meta, indent=2))
+
+
+class TokenShard:
+    """A memory-mapped shard written by export.
+
+    shard[i] returns the prompt and label token ids of sample i as views into the
+    token file; bucket(b) returns the row range of a length bucket, from which
+    batches of similar length can be drawn.
+    """
+
+    def __init__(self, out_dir, task, shard):
+        tokens_path, index_path, meta_path = shard_paths(out_dir, task, shard)
+        self.meta = json.loads(meta_path.read_text())
+        self.tokens = np.memmap(tokens_path, dtype=np.int32, mode="r")
+        self.index = np.load(index_path, mmap_mode="r")
+
+    def __len__(self):
+        return len(self.index)
+
+    def __getitem__(self, i):
+        _, p_start, p_len, l_start, l_len = self.index[i]
+        return (
+            self.tokens[p_start : p_start + p_len],
+            self.tokens[l_start : l_start + l_len],
+        )
+
+    def bucket(self, b):
+        return range(*self.meta["buckets"][str(b)])
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4:
+        print(
+            "Usage: python -m dataset.shards <data file> <out_dir> <tokenizer>"
+            " [num_shards] [trace_acceptance|causality|all]"
+        )
+        sys.exit(1)
+
+    # Only the command line needs transformers; export takes any HF-style tokenizer.
+    from transformers import AutoTokenizer
+
+    tokenizer = AutoTokenizer.from_pretrained(sys.argv[3])
+    num_shards = int(sys.argv[4]) if len(sys.argv) > 4 else 1
+    task = sys.argv[5] if len(sys.argv) > 5 else "all"
+
+    for t in TASKS if task == "all" else (task,):
+        print(f"[+] Exporting {t} to {sys.argv[2]}")
+        export(sys.argv[1], tokenizer, sys.argv[2], t, num_shards)
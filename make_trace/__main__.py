@@ -4,32 +4,20 @@
 This module provides a command-line interface for the complete pipeline:
 TLSF -> Automata -> Trace -> Causality -> Reasoning
 """
-import atexit
-import glob
 import json
 import logging
 import os
 import sys
-import tempfile
 from datetime import datetime
-from multiprocessing import Manager, Pool, Process, cpu_count
+from functools import partial
+from multiprocessing import Process, Queue, cpu_count
 from pathlib import Path
+from queue import Empty
 
 from tqdm import tqdm
 
-from .pipeline import pipeline
-
-
-def cleanup_tempfiles():
-    tmpdir = tempfile.gettempdir()
-    for tf in glob.glob(os.path.join(tmpdir, "tempo_bench_effect_*.hoa")):
-        try:
-            os.unlink(tf)
-        except OSError as e:
-            logging.warning(f"Could not delete temp file {tf}: {e}")
-
-
-atexit.register(cleanup_tempfiles)
+from . import cause, dedup, schedule, sink, spans
+from .pipeline import job_dir, pipeline
 
 
 def set_logging_level(level=logging.WARNING):
@@ -49,55 +37,156 @@ def set_logging_level(level=logging.WARNING):
         pipeline_logger.addHandler(handler)
 
 
-def process_tlsf(args):
+def process_tlsf(
+    tlsf_file,
+    num_run,
+    timeout,
+    seed,
+    config_file,
+    quiet,
+    debug,
+    profile,
+    results_dir,
+    dedup_mode,
+    job,
+):
     """Process a single TLSF file through the pipeline.
 
-    Unpacks args tuple (num_run, tlsf_file, config_file, timeout, queue, quiet,
-    cancel_event) and runs pipeline. Results or errors are sent to the queue for
-    collection.
+    Runs in a scheduler worker; the scheduler turns the returned result (or the
+    raised exception) into the JSONL record for the run.
     """
-    num_run, tlsf_file, config_file, timeout, queue, quiet, cancel_event = args
-    try:
-        # Suppress logs in parallel mode if quiet is True
-        if quiet:
-            set_logging_level(logging.WARNING)
+    # Suppress logs in parallel mode if quiet is True
+    if quiet:
+        set_logging_level(logging.WARNING)
+    return pipeline(
+        tlsf_file,
+        config_file,
+        num_run,
+        timeout,
+        debug,
+        profile,
+        results_dir,
+        dedup_mode,
+        job,
+        seed=seed,
+    )
+
+
+def cover(union, result):
+    """Adds the coverage (and the effects) of one run to the coverage union of its
+    spec."""
+    run = result.get("coverage")
+    if not run:
+        return
+    for key in ("states", "edges"):
+        union.setdefault(key, set()).update(run[key])
+    union.setdefault("effects", set()).update(result.get("effects", []))
+    union["system_states"] = run["system_states"]
+    union["system_edges"] = run["system_edges"]
 
-        # Check if another proc cancelled already
-        if cancel_event.is_set():
-            queue.put({"file": tlsf_file, "result": None, "error": "Cancelled"})
-            return
-        result = pipeline(tlsf_file, config_file, num_run, timeout)
-        queue.put({"file": tlsf_file, "result": result, "error": None})
-    except Exception as e:
-        cancel_event.set()  # tell siblings to stop
-        queue.put({"file": tlsf_file, "result": None, "error": str(e)})
 
+def coverage_stats(union):
+    return {
+        "states": len(union.get("states", ())),
+        "edges": len(union.get("edges", ())),
+        "effects": len(union.get("effects", ())),
+        "system_states": union.get("system_states"),
+        "system_edges": union.get("system_edges"),
+    }
 
-def writer_process(queue, output_file):
-    """Write pipeline results to output file as JSONL.
 
-    Continuously reads from queue until 'DONE' sentinel is received. Each result is
-    written as a JSON line and flushed immediately.
+def writer_process(queue, output_file):
+    """Write pipeline results to output file as zstd-compressed JSONL chunks.
+
+    Continuously reads from queue until 'DONE' sentinel is received. Results are
+    batched by sink.ChunkWriter, which stores each system HOA once in a side table
+    and syncs every chunk to disk; an idle queue flushes the pending chunk. Runs
+    whose duplicate trace was skipped are only counted. The stage spans of all
+    results, the number of unique traces per spec and the states, edges and
+    effects each spec's runs covered are summarized into
+    <output_file>.summary.json at the end of the job.
     """
 
-    with open(output_file, "w", encoding="utf-8") as f:
+    job_spans = []
+    # spec -> {"runs", "unique", "duplicates", "skipped"}
+    traces = {}
+    # spec -> union of the states, edges and effects its runs covered
+    coverage = {}
+    writer = sink.ChunkWriter(output_file)
+    try:
         while True:
-            item = queue.get()
+            try:
+                item = queue.get(timeout=sink.CHUNK_SECONDS)
+            except Empty:
+                writer.flush()
+                continue
             if item == "DONE":  # sentinel to stop
                 logging.info("writer exiting")
                 break
-            f.write(json.dumps(item) + "\n")
-            f.flush()  # stream safely to disk
+            result = item.get("result")
+            if result:
+                job_spans.extend(result.get("spans", []))
+                counts = traces.setdefault(
+                    item["file"],
+                    {"runs": 0, "unique": 0, "duplicates": 0, "skipped": 0},
+                )
+                cover(coverage.setdefault(item["file"], {}), result)
+                counts["runs"] += 1
+                counts["duplicates" if result.get("duplicate") else "unique"] += 1
+                if result.get("skipped"):
+                    counts["skipped"] += 1
+                    continue
+            writer.add(item)
+    finally:
+        writer.close()
+
+    summary = spans.summarize(job_spans)
+    covered = {spec: coverage_stats(c) for spec, c in coverage.items()}
+    report = {"stages": summary, "traces": traces, "coverage": covered}
+    Path(f"{output_file}.summary.json").write_text(json.dumps(report, indent=2))
+    for spec, counts in traces.items():
+        print(
+            f"{spec}: {counts['unique']}/{counts['runs']} unique traces"
+            f" ({counts['skipped']} duplicates skipped)"
+        )
+    for spec, c in covered.items():
+        print(
+            f"{spec}: covered {c['states']}/{c['system_states']} states,"
+            f" {c['edges']}/{c['system_edges']} edges, {c['effects']} effects"
+        )
+    for stage, stats in summary.items():
+        logging.info(
+            f"{stage}: n={stats['count']} total={stats['total_wall']:.2f}s"
+            f" p50={stats['p50_wall']:.3f}s p95={stats['p95_wall']:.3f}s"
+            f" max_states={stats['max_states']} rss={stats['max_peak_rss_kb']}KiB"
+        )
 
 
 def run_parallel(
-    tlsf_dir, config_file, output_dir, num_runs, n_jobs=None, timeout=300, quiet=True
+    tlsf_dir,
+    config_file,
+    output_dir,
+    num_runs,
+    n_jobs=None,
+    timeout=300,
+    quiet=True,
+    debug=False,
+    profile="balanced",
+    retries=2,
+    keep_artifacts=False,
+    dedup_mode="reuse",
 ):
     """Process all TLSF files in a directory in parallel.
 
-    Uses multiprocessing to run pipeline on multiple files concurrently. Results are
-    collected via queue and written to output_file as JSONL. n_jobs defaults to CPU
-    count if not specified.
+    Tasks are run by a schedule.Scheduler: the largest cached systems go first,
+    idle workers take the next pending task, timeouts adapt per spec and failed
+    runs are retried up to retries times. Results are collected via queue and
+    written to output_file as JSONL. n_jobs defaults to CPU count if not
+    specified. Runs stay in memory unless keep_artifacts or debug is set, in which
+    case all runs of the job write their artifacts below one results directory
+    (debug additionally keeps the cause automata); profile selects the
+    postprocessing effort of cause synthesis. Duplicate traces within the job are
+    handled according to dedup_mode (see pipeline).
     """
     tlsf_files = [str(p) for p in Path(tlsf_dir).glob("*.tlsf")]
     if not tlsf_files:
@@ -105,52 +194,77 @@ def run_parallel(
         return
 
     n_jobs = n_jobs or cpu_count()
-    manager = Manager()
-    queue = manager.Queue()
-
-    cancel_map = {f: manager.Event() for f in tlsf_files}
 
     ts = datetime.now().strftime("%Y%m%d_%H%M%S")
-    output_file = os.path.join(output_dir, f"data_{ts}.jsonl")
+    output_file = os.path.join(output_dir, f"data_{ts}.jsonl.zst")
+    job = f"{ts}-{os.getpid()}"
+
+    queue = Queue()
     writer = Process(target=writer_process, args=(queue, output_file))
     writer.start()
 
-    try:
-        with Pool(n_jobs) as pool:
-            for _ in tqdm(
-                pool.imap_unordered(
-                    process_tlsf,
-                    [
-                        (num_run, f, config_file, timeout, queue, quiet, cancel_map[f])
-                        for f in tlsf_files
-                        for num_run in range(num_runs)
-                    ],
-                ),
-                total=len(tlsf_files) * num_runs,
-                desc="Processing TLSF files",
-            ):
-                pass
-    except KeyboardInterrupt:
-        print("\n[!] Caught Ctrl-C, terminating workers...")
-        pool.terminate()
-        pool.join()
-        queue.put("DONE")
-        writer.terminate()
-        writer.join()
-        raise
-    else:
-        queue.put("DONE")
-        writer.join()
+    results_dir = job_dir() if keep_artifacts or debug else None
+    run = partial(
+        process_tlsf,
+        config_file=config_file,
+        quiet=quiet,
+        debug=debug,
+        profile=profile,
+        results_dir=results_dir,
+        dedup_mode=dedup_mode,
+        job=job,
+    )
+    scheduler = schedule.Scheduler(run, n_jobs, timeout, retries)
+    tasks = [
+        schedule.Task(f, num_run) for f in tlsf_files for num_run in range(num_runs)
+    ]
+
+    with tqdm(total=len(tasks), desc="Processing TLSF files") as progress:
+
+        def emit(record):
+            queue.put(record)
+            progress.update()
+
+        try:
+            scheduler.run(tasks, emit)
+        except KeyboardInterrupt:
+            # Let the writer flush its last chunk instead of terminating it.
+            print("\n[!] Caught Ctrl-C, terminating workers...")
+            queue.put("DONE")
+            writer.join()
+            raise
+
+    queue.put("DONE")
+    writer.join()
 
 
 if __name__ == "__main__":
-    # cleans up tempfiles
-    atexit.register(cleanup_tempfiles)
+    # --profile=<fast|balanced|minimal> may appear anywhere on the command line
+    profile = "balanced"
+    for arg in [a for a in sys.argv if a.startswith("--profile=")]:
+        profile = arg.split("=", 1)[1]
+        sys.argv.remove(arg)
+    if profile not in cause.PROFILES:
+        print(f"Unknown profile {profile!r} (expected {'|'.join(cause.PROFILES)})")
+        sys.exit(2)
+    # --dedup=<reuse|skip|off> handles duplicate traces of a spec within a job
+    dedup_mode = "reuse"
+    for arg in [a for a in sys.argv if a.startswith("--dedup=")]:
+        dedup_mode = arg.split("=", 1)[1]
+        sys.argv.remove(arg)
+    if dedup_mode not in dedup.MODES:
+        print(f"Unknown dedup mode {dedup_mode!r} (expected {'|'.join(dedup.MODES)})")
+        sys.exit(2)
+    # --keep-artifacts writes every run's intermediate files to a results directory
+    keep_artifacts = "--keep-artifacts" in sys.argv
+    if keep_artifacts:
+        sys.argv.remove("--keep-artifacts")
 
     if len(sys.argv) < 2 or sys.argv[1] == "-h" or sys.argv[1] not in ["-s", "-p"]:
         print(
-            "Usage: make_trace [-h] [-s <tlsf_file>] [-p <tlsf_dir>\
- <output_dir> [num_runs per file] [n_jobs] [timeout]]"
+            "Usage: make_trace [-h] [--profile=<fast|balanced|minimal>]\
+ [--dedup=<reuse|skip|off>] [--keep-artifacts] [-s <tlsf_file>]\
+ [-p <tlsf_dir> <output_dir> [num_runs per file] [n_jobs] [timeout]]"
         )
         print(
             " \
@@ -164,11 +278,20 @@ if __name__ == "__main__":
         sys.exit(1)
 
     config_file = os.path.join(os.path.dirname(__file__), "random_config.toml")
+    # DEBUG=1 keeps the per-effect cause automata next to the other run artifacts
+    debug = os.environ.get("DEBUG", "").lower() not in ("", "0", "false")
 
     if sys.argv[1] == "-s":
         # Set logging to INFO for single file processing
         set_logging_level(logging.INFO)
-        result = pipeline(sys.argv[2], config_file)
+        result = pipeline(
+            sys.argv[2],
+            config_file,
+            debug=debug,
+            profile=profile,
+            results_dir=job_dir() if keep_artifacts else None,
+            dedup_mode=dedup_mode,
+        )
         print(json.dumps(result, indent=2))
         exit(0)
 
@@ -189,4 +312,8 @@ if __name__ == "__main__":
             n_jobs,
             timeout=timeout,
             quiet=True,
+            debug=debug,
+            profile=profile,
+            keep_artifacts=keep_artifacts,
+            dedup_mode=dedup_mode,
         )
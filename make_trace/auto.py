@@ -6,6 +6,11 @@ from itertools import chain, combinations
 import buddy
 import spot
 
+# BuDDy grows its node table by at most this many nodes per resize by default.
+BDD_DEFAULT_INCREASE = 50000
+# Rough number of BDD nodes the cause synthesis of a system needs per edge and AP.
+BDD_NODES_PER_EDGE_AP = 64
+
 
 def powerset(iterable):
     s = list(iterable)
@@ -37,11 +42,6 @@ def construct_counterfactual_automaton(system, trace):
             smap[pair] = p
         return p
 
-    # We organize the (virtual) states that need to be constructed in this todo
-    # list, and the fully expanded ones in the picked list.
-    todo = [(system.get_init_state_number(), 0)]
-    picked = set()
-
     # Save length of trace prefix and loop
     len_prefix = len(trace.prefix)
     len_loop = len(trace.cycle)
@@ -59,6 +59,7 @@ def construct_counterfactual_automaton(system, trace):
     # Separate APs into inputs and outputs
     outputs = spot.get_synthesis_output_aps(system)
     inputs = set(str(a) for a in system.ap()).difference(set(str(p) for p in outputs))
+    subsets = list(powerset(list(outputs)))
 
     # construct preconditions for contingency edge construction
     pre = {}
@@ -66,68 +67,92 @@ def construct_counterfactual_automaton(system, trace):
     # variables (this will later decide whether a contingency edge to this
     # state exists).
     for e in system.edges():
-        cond = e.cond
-        for i in inputs:
-            ibdd = buddy.bdd_ithvar(result.register_ap(i))
-            buddy.bdd_exist(cond, ibdd)
+        cond = project_away(system, e.cond, inputs)
         if pre.get(e.dst) is None:
             pre[e.dst] = cond
         else:
-            pre[e.dst] = pre[e.dst] | cond
-
-    # Main loop iterates over the virtual states of the integral automaton.
-    for q, n in todo:
-
-        # It may happen that a state is added to the todo list several times,
-        # so we first check whether it was picked before.
-        if (q, n) in picked:
-            continue
-
-        # We remember that we picked (q,n) and will subsequently fully expand
-        # it.
-        picked.add((q, n))
-
-        # We move to the next implicit copy of the system, except at the end of
-        # the loop, where we return to the loop entry point.
-        next = n + 1 if n + 1 < len_prefix + len_loop else len_prefix
-
-        # We proceed to construct the edges that go from the virtual state to
-        # the next copy in the integral automaton.
-        for edge in system.out(q):
-
-            # Build the guard for the inputs.
-            res_guard_in = project_away(system, edge.cond, outputs)
-
-            # The output constraints depend on whether contingencies are
-            # enabled, but are always based on the original guard.
-            guard_out = project_away(system, edge.cond, inputs)
-
-            # Build the guard for the outputs+contingencies by constructing the
-            # latter and possibly adding new edges to states if their
-            # precondition allows.
-            for state, precon in pre.items():
-                res_guard_out = buddy.bddfalse
-                for subset in powerset(list(outputs)):
-                    guard_aux = project_away(system, guard_out, subset)
-                    for o in subset:
-                        oorig = buddy.bdd_ithvar(result.register_ap(o))
-                        if buddy.bdd_and(tr(n), oorig) != buddy.bddfalse:
-                            guard_aux = buddy.bdd_and(guard_aux, oorig)
-                        else:
-                            guard_aux = buddy.bdd_and(guard_aux, buddy.bdd_not(oorig))
-
-                    if buddy.bdd_and(precon, guard_aux) != buddy.bddfalse:
-                        res_guard_out = buddy.bdd_or(res_guard_out, guard_aux)
-
-                if res_guard_out != buddy.bddfalse:
+            pre[e.dst] = buddy.bdd_or(pre[e.dst], cond)
+
+    # For every trace position and every subset of outputs, the conjunction of
+    # the output values the trace fixes at that position; computed once instead
+    # of once per (edge, target state) pair.
+    fixed = []
+    for n in range(len_prefix + len_loop):
+        literals = {}
+        for o in outputs:
+            oorig = buddy.bdd_ithvar(result.register_ap(o))
+            if buddy.bdd_and(tr(n), oorig) != buddy.bddfalse:
+                literals[str(o)] = oorig
+            else:
+                literals[str(o)] = buddy.bdd_not(oorig)
+        conjunctions = []
+        for subset in subsets:
+            conj = buddy.bddtrue
+            for o in subset:
+                conj = buddy.bdd_and(conj, literals[str(o)])
+            conjunctions.append(conj)
+        fixed.append(conjunctions)
+
+    # For every edge, the guard for the inputs and the output guard with each
+    # subset of outputs projected away; these do not depend on the position.
+    expansions = {}
+
+    def expand(q):
+        edges = expansions.get(q)
+        if edges is None:
+            edges = []
+            for edge in system.out(q):
+                # Build the guard for the inputs.
+                guard_in = project_away(system, edge.cond, outputs)
+                # The output constraints depend on whether contingencies are
+                # enabled, but are always based on the original guard.
+                guard_out = project_away(system, edge.cond, inputs)
+                projected = [project_away(system, guard_out, s) for s in subsets]
+                edges.append((guard_in, projected))
+            expansions[q] = edges
+        return edges
+
+    # We expand the (virtual) states of the integral automaton frontier by
+    # frontier, in a fixed order, so that the state numbering is deterministic.
+    init = (system.get_init_state_number(), 0)
+    result.set_init_state(lookup(*init))
+    picked = {init}
+    frontier = [init]
+
+    while frontier:
+        next_frontier = []
+        for q, n in frontier:
+
+            # We move to the next implicit copy of the system, except at the end
+            # of the loop, where we return to the loop entry point.
+            next = n + 1 if n + 1 < len_prefix + len_loop else len_prefix
+
+            # We proceed to construct the edges that go from the virtual state to
+            # the next copy in the integral automaton.
+            for res_guard_in, projected in expand(q):
+                guards_aux = [buddy.bdd_and(p, f) for p, f in zip(projected, fixed[n])]
+
+                # Build the guard for the outputs+contingencies and possibly add
+                # new edges to states if their precondition allows.
+                for state, precon in pre.items():
+                    res_guard_out = buddy.bddfalse
+                    for guard_aux in guards_aux:
+                        if buddy.bdd_and(precon, guard_aux) != buddy.bddfalse:
+                            res_guard_out = buddy.bdd_or(res_guard_out, guard_aux)
+
+                    if res_guard_out == buddy.bddfalse:
+                        continue
                     result.new_edge(
                         lookup(q, n),
                         lookup(state, next),
                         buddy.bdd_and(res_guard_in, res_guard_out),
                     )
-                # Target state comes into the todo list if not already expanded.
-                if not (state, next) in picked:
-                    todo.append((edge.dst, next))
+                    # Target state is expanded in the next frontier if it was not
+                    # picked before.
+                    if (state, next) not in picked:
+                        picked.add((state, next))
+                        next_frontier.append((state, next))
+        frontier = next_frontier
 
     return result
 
@@ -168,13 +193,249 @@ def project_existentially(automaton, aps):
     return automaton
 
 
+def rename_aps(automaton, renaming):
+    """Returns a copy of the automaton whose APs are renamed according to the given
+    dict, without any serialization.
+
+    The copy shares the bdd_dict of the original, and every guard is rewritten by a
+    single BDD variable substitution. New names must not already occur in the
+    automaton.
+    """
+    result = spot.make_twa_graph(automaton, spot.twa_prop_set.all())
+    outputs = [str(o) for o in spot.get_synthesis_output_aps(automaton)]
+
+    # Register all new variables before building the pair so that it covers them.
+    variables = [
+        (result.register_ap(old), result.register_ap(new))
+        for old, new in renaming.items()
+    ]
+
+    pairs = buddy.bdd_newpair()
+    for old, new in variables:
+        buddy.bdd_setpair(pairs, old, new)
+    for e in result.edges():
+        e.cond = buddy.bdd_replace(e.cond, pairs)
+    buddy.bdd_freepair(pairs)
+
+    for old, _ in variables:
+        result.unregister_ap(old)
+
+    # Keep the controllable APs (if any) pointing at their renamed counterparts.
+    if outputs:
+        outs = buddy.bddtrue
+        for o in outputs:
+            outs = buddy.bdd_and(
+                outs, buddy.bdd_ithvar(result.register_ap(renaming.get(o, o)))
+            )
+        spot.set_synthesis_outputs(result, outs)
+
+    return result
+
+
 def add_suffix(automaton, suffix):
     """Adds a suffix to all atomic propositions of the automaton."""
-    return spot.automaton(
-        automaton.to_str().replace('" ', suffix + '"').replace('"\n', suffix + '"')
-    )
+    return rename_aps(automaton, {str(a): str(a) + suffix for a in automaton.ap()})
 
 
 def remove_suffix(automaton, suffix):
     """Removes a suffix from all atomic propositions of the automaton."""
-    return spot.automaton(automaton.to_str().replace(suffix + '"', '"'))
+    return rename_aps(
+        automaton,
+        {
+            str(a): str(a)[: -len(suffix)]
+            for a in automaton.ap()
+            if str(a).endswith(suffix)
+        },
+    )
+
+
+def accepts(automaton, words):
+    """Decides for each word (a spot.twa_word or its string form) whether the automaton
+    accepts it, returning one bool per word.
+
+    Lassos are walked directly along the automaton, which for deterministic automata
+    such as the Mealy machines produced by ltlsynt never builds a product. Only when
+    the walk branches under a non-trivial acceptance condition do we fall back to
+    intersecting with the word automaton.
+    """
+    result = []
+    for word in words:
+        if isinstance(word, str):
+            word = spot.parse_word(word, automaton.get_dict())
+        verdict = walk_lasso(automaton, word)
+        if verdict is None:
+            verdict = automaton.intersects(word.as_automaton())
+        result.append(verdict)
+    return result
+
+
+def successors(automaton, states, letter):
+    """Returns the set of states reachable from states by reading letter."""
+    return set(
+        e.dst
+        for q in states
+        for e in automaton.out(q)
+        if buddy.bdd_and(e.cond, letter) != buddy.bddfalse
+    )
+
+
+def walk_lasso(automaton, word):
+    """Walks the automaton along the lasso-shaped word.
+
+    Returns the acceptance verdict, or None if it cannot be decided by walking.
+    """
+    states = {automaton.get_init_state_number()}
+    for letter in word.prefix:
+        states = successors(automaton, states, letter)
+        if not states:
+            return False
+
+    cycle = list(word.cycle)
+
+    # With a trivial acceptance condition any infinite run is accepting, so it
+    # suffices to find one that reads the cycle forever.
+    if automaton.acc().is_t():
+        return has_infinite_run(automaton, states, cycle)
+
+    if len(states) != 1:
+        return None
+
+    # Deterministic walk around the cycle until a (state, position) pair repeats;
+    # the marks seen since the first occurrence are the ones seen infinitely often.
+    (state,) = states
+    seen = {}
+    marks = []
+    pos = 0
+    while (state, pos) not in seen:
+        seen[(state, pos)] = len(marks)
+        edges = [
+            e
+            for e in automaton.out(state)
+            if buddy.bdd_and(e.cond, cycle[pos]) != buddy.bddfalse
+        ]
+        if not edges:
+            return False
+        if len(edges) > 1:
+            return None
+        marks.append(edges[0].acc)
+        state = edges[0].dst
+        pos = (pos + 1) % len(cycle)
+
+    inf = spot.mark_t()
+    for m in marks[seen[(state, pos)] :]:
+        inf = inf | m
+    return automaton.acc().accepting(inf)
+
+
+def has_infinite_run(automaton, states, cycle):
+    """Checks whether some run from one of the states can read the cycle forever."""
+    graph = {}
+    todo = [(q, 0) for q in states]
+    while todo:
+        q, pos = todo.pop()
+        if (q, pos) in graph:
+            continue
+        nxt = (pos + 1) % len(cycle)
+        graph[(q, pos)] = [(d, nxt) for d in successors(automaton, [q], cycle[pos])]
+        todo.extend(graph[(q, pos)])
+
+    # Repeatedly drop nodes without live successors; what remains lies on or leads
+    # to a cycle of the (finite) product.
+    live = set(graph)
+    changed = True
+    while changed:
+        dead = [n for n in live if not any(s in live for s in graph[n])]
+        live.difference_update(dead)
+        changed = bool(dead)
+
+    return any((q, 0) in live for q in states)
+
+
+def stats(automaton):
+    """Returns the autfilt-style stats line of the automaton."""
+    return (
+        f"{automaton.num_states()} states, {automaton.num_edges()} edges, "
+        f"{automaton.num_sets()} acc-sets, {spot.scc_info(automaton).scc_count()} "
+        f"SCCs, det={int(spot.is_deterministic(automaton))}\n"
+    )
+
+
+def reserve_bdd_nodes(automaton):
+    """Sizes BuDDy's node table growth for synthesizing causes on the automaton.
+
+    BuDDy cannot preallocate its table once it is initialized, but growing it in
+    steps proportional to the expected working set (instead of the default 50000
+    nodes) and keeping more nodes free avoids most of the garbage collections and
+    resizes a large system triggers.
+    """
+    estimate = automaton.num_edges() * len(automaton.ap()) * BDD_NODES_PER_EDGE_AP
+    if estimate > BDD_DEFAULT_INCREASE:
+        buddy.bdd_setmaxincrease(estimate)
+        buddy.bdd_setminfreenodes(30)
+
+
+def is_simulated(left, right):
+    """Checks whether the initial state of right directly simulates the initial
+    state of left, which implies that the language of left is included in that of
+    right.
+
+    Both automata must be Büchi automata over the same bdd_dict. The simulation
+    is computed as a greatest fixpoint over the state pairs reachable from the
+    initial pair: a pair is dropped as soon as some letter of an out-edge of the
+    left state is not matched by an out-edge of the right state that is accepting
+    whenever the left one is and leads to a pair that is still in the relation, and
+    the pairs leading to it are checked again. A False result is inconclusive.
+    """
+    if not (left.acc().is_buchi() and right.acc().is_buchi()):
+        return False
+
+    def edges(automaton):
+        return [
+            [(e.cond, e.dst, e.acc.has(0)) for e in automaton.out(q)]
+            for q in range(automaton.num_states())
+        ]
+
+    left_edges, right_edges = edges(left), edges(right)
+
+    def moves(p, q):
+        for cond, dst, acc in left_edges[p]:
+            for right_cond, right_dst, right_acc in right_edges[q]:
+                if acc and not right_acc:
+                    continue
+                if buddy.bdd_and(cond, right_cond) != buddy.bddfalse:
+                    yield dst, right_dst
+
+    # Only the pairs reachable from the initial one can matter for it.
+    init = (left.get_init_state_number(), right.get_init_state_number())
+    relation = {init}
+    predecessors = {init: set()}
+    stack = [init]
+    while stack:
+        pair = stack.pop()
+        for succ in moves(*pair):
+            if succ not in relation:
+                relation.add(succ)
+                predecessors[succ] = set()
+                stack.append(succ)
+            predecessors[succ].add(pair)
+
+    def matched(p, q):
+        for cond, dst, acc in left_edges[p]:
+            covered = buddy.bddfalse
+            for right_cond, right_dst, right_acc in right_edges[q]:
+                if (right_acc or not acc) and (dst, right_dst) in relation:
+                    covered = buddy.bdd_or(covered, right_cond)
+            if buddy.bdd_and(cond, buddy.bdd_not(covered)) != buddy.bddfalse:
+                return False
+        return True
+
+    worklist = list(relation)
+    while worklist:
+        pair = worklist.pop()
+        if pair not in relation or matched(*pair):
+            continue
+        if pair == init:
+            return False
+        relation.discard(pair)
+        worklist.extend(predecessors[pair] & relation)
+    return True
@@ -0,0 +1,367 @@
+"""This module benchmarks every pipeline stage over a directory of TLSF specs and
+compares the results against a saved baseline to catch slowdowns. In sweep mode it
+instead scales one GLOBAL PARAMETER of a single spec to find where stages stop
+scaling.
+
+Usage: python -m make_trace.bench [options] <tlsf_dir>
+       python -m make_trace.bench [options] --sweep=<name>=<lo>:<hi>[:<step>] <tlsf>
+"""
+
+import getopt
+import json
+import logging
+import subprocess
+import sys
+from pathlib import Path
+
+from . import auto, cache, cause, spans, synth
+from .sample import Sampler
+
+logger = logging.getLogger(__name__)
+
+# Cause synthesis configurations as (name, contingencies, limit_assumption).
+CONFIGS = [
+    ("plain", False, False),
+    ("contingencies", True, False),
+    ("limit", False, True),
+    ("contingencies+limit", True, True),
+]
+
+# A stage regresses if its p50 latency exceeds the baseline by this factor ...
+TOLERANCE = 1.25
+# ... and by at least this many seconds, so that timer noise is not reported.
+NOISE_FLOOR = 0.005
+
+
+def stage_key(span):
+    """Returns the report key of a span: its stage, prefixed with its label."""
+    if "label" in span:
+        return f"{span['label']} {span['stage']}"
+    return span["stage"]
+
+
+def bench_spec(
+    tlsf_file, seeds, bound=10, profile="balanced", timeout=300, params=None
+):
+    """Runs all stages on one spec for every seed and returns the recorded spans.
+
+    Synthesis always runs uncached, with params overriding GLOBAL PARAMETERS of the
+    spec. Each seed samples one trace, checks its acceptance and synthesizes the
+    causes of all its effects under every configuration in CONFIGS; a
+    configuration that exceeds the timeout skips its remaining effects, and its
+    "configuration" span is marked as timed_out.
+    """
+    recorder = spans.Recorder()
+
+    with recorder.span("syfco outputs"):
+        outputs = cache.extract_outputs(tlsf_file, params)
+    with recorder.span("synthesis") as span:
+        system = span.automaton(
+            synth.synthesize_tlsf(tlsf_file, outputs, timeout, params)
+        )
+
+    for seed in seeds:
+        with recorder.span("sampling"):
+            sampler = Sampler(system, "random", bound, seed)
+            steps = sampler.walk()
+            trace = sampler.as_word(steps, sampler.loop)
+
+        with recorder.span("acceptance"):
+            auto.accepts(system, [trace])
+
+        for name, contingencies, limit_assumption in CONFIGS:
+            recorder.label = name
+            with recorder.span("configuration") as config_span:
+                config_span["timed_out"] = not bench_config(
+                    recorder,
+                    system,
+                    trace,
+                    outputs,
+                    contingencies,
+                    limit_assumption,
+                    profile,
+                    timeout,
+                )
+            recorder.label = None
+
+    return recorder.spans
+
+
+def bench_config(
+    recorder, system, trace, outputs, contingencies, limit_assumption, profile, timeout
+):
+    """Synthesizes the causes of all effects of the trace under one configuration
+    and returns False if it ran out of time."""
+    try:
+        synthesizer = cause.Synthesizer(
+            system,
+            trace,
+            limit_assumption,
+            contingencies,
+            cause.Deadline(timeout),
+            lazy=True,
+            profile=profile,
+            recorder=recorder,
+        )
+        for output in outputs:
+            offsets = synthesizer.output_timesteps(output)
+            results = synthesizer.synthesize_shifted(output, offsets)
+            for _ in offsets:
+                with recorder.span("cause"):
+                    next(results)
+    except TimeoutError as e:
+        logger.warning(f"{recorder.label}: {e}")
+        return False
+    return True
+
+
+def report(spec_spans):
+    """Aggregates the spans of each spec into a per-stage report with throughput
+    (runs per second), latency percentiles, peak memory and, for configurations,
+    the number of runs that timed out."""
+    result = {}
+    for spec, recorded in spec_spans.items():
+        keyed = [dict(span, stage=stage_key(span)) for span in recorded]
+        summary = spans.summarize(keyed)
+        for stage, stats in summary.items():
+            total = stats["total_wall"]
+            stats["per_sec"] = stats["count"] / total if total > 0 else None
+            stats["timed_out"] = sum(
+                bool(span.get("timed_out")) for span in keyed if span["stage"] == stage
+            )
+        result[spec] = summary
+    return result
+
+
+def compare(current, baseline, tolerance=TOLERANCE, failed=None):
+    """Returns a list of (spec, stage, reason) for every regression against the
+    baseline: a stage whose median latency regressed or that timed out more often,
+    and a spec or stage of the baseline that failed (failed maps specs to their
+    error) or is missing from the current run."""
+    failed = failed or {}
+    regressions = [(spec, None, f"failed: {error}") for spec, error in failed.items()]
+    for spec, old_summary in baseline.items():
+        if spec in failed:
+            continue
+        if spec not in current:
+            regressions.append((spec, None, "missing from the current run"))
+            continue
+        for stage, old in old_summary.items():
+            stats = current[spec].get(stage)
+            if stats is None:
+                regressions.append((spec, stage, "missing from the current run"))
+                continue
+            before, after = old["p50_wall"], stats["p50_wall"]
+            if after > before * tolerance and after - before > NOISE_FLOOR:
+                regressions.append((spec, stage, f"p50 {before:.4f}s -> {after:.4f}s"))
+            timed_out = old.get("timed_out", 0)
+            if stats["timed_out"] > timed_out:
+                reason = (
+                    f"timed out {stats['timed_out']}/{stats['count']} runs"
+                    f" (baseline: {timed_out}/{old['count']})"
+                )
+                regressions.append((spec, stage, reason))
+    return regressions
+
+
+def parse_sweep(arg):
+    """Parses ``name=lo:hi[:step]`` into the parameter name and its values."""
+    name, _, bounds = arg.partition("=")
+    lo, hi, *step = (int(b) for b in bounds.split(":"))
+    return name, range(lo, hi + 1, step[0] if step else 1)
+
+
+def sweep(tlsf_file, name, values, seeds, bound=10, profile="balanced", timeout=300):
+    """Benchmarks one spec for every value of the parameter name and returns a
+    report keyed by ``name=value``.
+
+    Besides the per-stage summary, each entry records the timeout rate of every
+    configuration. The sweep stops at the first value for which synthesis itself
+    fails or times out, since larger values will not fare better. Both syfco and
+    Spot's game solving are bounded by timeout (see synth.synthesize_bounded), so
+    a blowup ends the sweep instead of hanging it.
+    """
+    result = {}
+    for value in values:
+        key = f"{name}={value}"
+        logger.info(f"[+] Sweeping {tlsf_file} with {key}")
+        # TimeoutExpired comes from syfco or from the killed synthesis process.
+        try:
+            recorded = bench_spec(
+                tlsf_file, seeds, bound, profile, timeout, {name: value}
+            )
+        except (subprocess.TimeoutExpired, RuntimeError) as e:
+            logger.warning(f"Synthesis failed for {key}, stopping sweep: {e}")
+            result[key] = {"failed": str(e)}
+            break
+
+        (entry,) = report({key: recorded}).values()
+        timeouts = {}
+        for span in recorded:
+            if span["stage"] == "configuration":
+                runs, failed = timeouts.get(span["label"], (0, 0))
+                timeouts[span["label"]] = (runs + 1, failed + span["timed_out"])
+        entry["timeout_rate"] = {c: f / r for c, (r, f) in timeouts.items()}
+        result[key] = entry
+    return result
+
+
+def print_sweep(result):
+    """Prints one line per parameter value with the synthesis time, the system
+    size and, per configuration, the p50 cause latency and the timeout rate."""
+    for key, entry in result.items():
+        if "failed" in entry:
+            print(f"{key}: synthesis failed ({entry['failed']})")
+            continue
+        synthesis = entry["synthesis"]
+        line = (
+            f"{key}: synthesis={synthesis['total_wall']:.3f}s"
+            f" states={synthesis['max_states']} edges={synthesis['max_edges']}"
+        )
+        for name, _, _ in CONFIGS:
+            causes = entry.get(f"{name} cause")
+            p50 = f"{causes['p50_wall']:.3f}s" if causes else "-"
+            rate = entry["timeout_rate"].get(name, 0)
+            line += f" | {name} p50={p50} timeouts={rate:.0%}"
+        print(line)
+
+
+def print_report(current):
+    for spec, summary in current.items():
+        print(spec)
+        for stage, s in summary.items():
+            per_sec = f"{s['per_sec']:.1f}/s" if s["per_sec"] is not None else "-"
+            print(
+                f"  {stage:<40} n={s['count']:<4} {per_sec:>9}"
+                f" p50={s['p50_wall']:.4f}s p95={s['p95_wall']:.4f}s"
+                f" max={s['max_wall']:.4f}s rss={s['max_peak_rss_kb']}KiB"
+                f" states={s['max_states']}"
+            )
+
+
+def main(argv):
+    seeds = 5
+    bound = 10
+    profile = "balanced"
+    timeout = 300
+    baselinefile = ""
+    savefile = ""
+    tolerance = TOLERANCE
+    sweeparg = ""
+    usage = """Usage: python -m make_trace.bench [options] <tlsf_dir>
+       python -m make_trace.bench [options] --sweep=<name>=<lo>:<hi>[:<step>] \
+<tlsf_file>"""
+
+    options = """Options are:
+        --seeds=<n>
+            number of traces sampled per spec (seeds 0..n-1, default: 5).
+        --bound=<n>
+            length of each sampled trace (default: 10).
+        --profile=<fast|balanced|minimal>
+            postprocessing effort of cause synthesis (default: balanced).
+        --timeout=<seconds>
+            time budget of each cause synthesis configuration (default: 300).
+        --baseline=<file>
+            compares against a saved report and exits with status 1 if a stage
+            regressed or timed out more often, or a spec or stage of the
+            baseline failed or is missing.
+        --tolerance=<factor>
+            allowed slowdown of the p50 latency (default: 1.25).
+        --save=<file>
+            saves the report, e.g. as the next baseline.
+        --sweep=<name>=<lo>:<hi>[:<step>]
+            benchmarks a single spec with its GLOBAL PARAMETER name overridden
+            (syfco -op) for every value in lo..hi, reporting synthesis time,
+            system size, cause latency and timeout rate per value.
+    """
+
+    man = "%s\n\n%s" % (usage, options)
+
+    try:
+        opts, args = getopt.getopt(
+            argv,
+            "h",
+            [
+                "help",
+                "seeds=",
+                "bound=",
+                "profile=",
+                "timeout=",
+                "baseline=",
+                "tolerance=",
+                "save=",
+                "sweep=",
+            ],
+        )
+    except getopt.GetoptError:
+        print(man)
+        sys.exit(2)
+
+    for opt, arg in opts:
+        if opt in ("-h", "--help"):
+            print(man)
+            sys.exit(2)
+        elif opt == "--seeds":
+            seeds = int(arg)
+        elif opt == "--bound":
+            bound = int(arg)
+        elif opt == "--profile":
+            if arg not in cause.PROFILES:
+                print(f"Unknown profile {arg!r} (expected {'|'.join(cause.PROFILES)})")
+                sys.exit(2)
+            profile = arg
+        elif opt == "--timeout":
+            timeout = int(arg)
+        elif opt == "--baseline":
+            baselinefile = arg
+        elif opt == "--tolerance":
+            tolerance = float(arg)
+        elif opt == "--save":
+            savefile = arg
+        elif opt == "--sweep":
+            sweeparg = arg
+
+    if len(args) != 1:
+        print(man)
+        sys.exit(2)
+
+    if sweeparg:
+        name, values = parse_sweep(sweeparg)
+        result = sweep(
+            Path(args[0]), name, values, range(seeds), bound, profile, timeout
+        )
+        print_sweep(result)
+        if savefile:
+            Path(savefile).write_text(json.dumps(result, indent=2))
+        return
+
+    spec_spans = {}
+    failed = {}
+    for tlsf_file in sorted(Path(args[0]).glob("*.tlsf")):
+        logger.info(f"[+] Benchmarking {tlsf_file}")
+        try:
+            spec_spans[tlsf_file.name] = bench_spec(
+                tlsf_file, range(seeds), bound, profile, timeout
+            )
+        except Exception as e:
+            logger.exception(f"Benchmark failed for {tlsf_file}")
+            failed[tlsf_file.name] = f"{type(e).__name__}: {e}"
+
+    current = report(spec_spans)
+    print_report(current)
+
+    if savefile:
+        Path(savefile).write_text(json.dumps(current, indent=2))
+
+    if baselinefile:
+        baseline = json.loads(Path(baselinefile).read_text())
+        regressions = compare(current, baseline, tolerance, failed)
+        for spec, stage, reason in regressions:
+            print(f"REGRESSION {spec}{f' {stage}' if stage else ''}: {reason}")
+        if regressions:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    logging.basicConfig(level=logging.INFO, format="%(levelname)s: %(message)s")
+    main(sys.argv[1:])
@@ -0,0 +1,127 @@
+"""This module caches the synthesized system of each TLSF spec on disk, so that all
+runs of a spec (across num_run iterations and Pool workers) share one synthesis."""
+
+import fcntl
+import hashlib
+import json
+import logging
+import os
+import subprocess
+from pathlib import Path
+
+import spot
+
+from . import auto, spans, synth
+
+logger = logging.getLogger(__name__)
+
+CACHE_DIR = Path(
+    os.environ.get("TEMPO_BENCH_CACHE", Path.home() / ".cache" / "tempo_bench")
+)
+
+# Systems already loaded by this process, keyed by spec key.
+_loaded = {}
+
+
+class SynthesisFailed(RuntimeError):
+    """Raised by load if the spec is unrealizable or its synthesis failed or timed
+    out; that is a property of the spec, so retrying its runs does not help."""
+
+
+def spec_key(tlsf_file: Path, params: dict = None):
+    """Key a spec by the hash of its TLSF content, its parameter overrides and the
+    Spot version."""
+    digest = hashlib.sha256(Path(tlsf_file).read_bytes())
+    digest.update(spot.version().encode("utf-8"))
+    if params:
+        digest.update(json.dumps(params, sort_keys=True).encode("utf-8"))
+    return digest.hexdigest()
+
+
+def extract_outputs(tlsf_file: Path, params: dict = None):
+    """Return the output signals of a TLSF file as reported by syfco."""
+    cmd = ["syfco", str(tlsf_file), *synth.overwrite_args(params), "-outs"]
+    res = subprocess.run(cmd, capture_output=True)
+
+    # NOTE: This fixes a bug where leading whitespaces caused effects to not be found
+    return [o.strip() for o in res.stdout.decode("utf-8").split(",")]
+
+
+def _fill(tlsf_file: Path, entry: Path, timeout: int, recorder, params):
+    """Synthesize the spec and store the system, its metadata and its stats under
+    entry."""
+    with recorder.span("syfco outputs"):
+        outputs = extract_outputs(tlsf_file, params)
+    try:
+        with recorder.span("synthesis") as span:
+            system = span.automaton(
+                synth.synthesize_tlsf(tlsf_file, outputs, timeout, params)
+            )
+    except (subprocess.SubprocessError, RuntimeError) as e:
+        raise SynthesisFailed(f"Synthesis of {tlsf_file} failed: {e}") from e
+    hoa = system.to_str("hoa")
+
+    meta = {
+        "spec": str(tlsf_file),
+        "spot": spot.version(),
+        "params": params or {},
+        "aps": [str(ap) for ap in system.ap()],
+        "outputs": outputs,
+        "stats": auto.stats(system),
+        "states": system.num_states(),
+        "edges": system.num_edges(),
+    }
+
+    # Write to temporaries first so readers never observe a partial entry.
+    tmp = entry.with_suffix(".tmp")
+    tmp.mkdir(parents=True, exist_ok=True)
+    (tmp / "system.hoa").write_text(hoa)
+    (tmp / "meta.json").write_text(json.dumps(meta, indent=2))
+    os.replace(tmp, entry)
+
+
+def peek(tlsf_file: Path, params: dict = None):
+    """Return the cached metadata of a spec, or None if it was not synthesized yet.
+
+    Never synthesizes, so it is cheap enough for schedulers to estimate task costs.
+    """
+    meta_file = CACHE_DIR / spec_key(tlsf_file, params) / "meta.json"
+    if not meta_file.exists():
+        return None
+    return json.loads(meta_file.read_text())
+
+
+def load(tlsf_file: Path, timeout: int = 300, recorder=None, params: dict = None):
+    """Return (system, meta) for the given spec, synthesizing it only on a miss.
+
+    The first process to miss takes an exclusive lock on the entry and synthesizes;
+    concurrent workers block on the lock and then read the finished entry. Each
+    process parses the cached HOA once and reuses the automaton afterwards. On a
+    miss, the synthesis steps are recorded as spans on recorder. params overrides
+    GLOBAL PARAMETERS of the spec and is part of the cache key.
+    """
+    key = spec_key(tlsf_file, params)
+    if key in _loaded:
+        return _loaded[key]
+
+    CACHE_DIR.mkdir(parents=True, exist_ok=True)
+    entry = CACHE_DIR / key
+
+    if not (entry / "meta.json").exists():
+        with open(CACHE_DIR / f"{key}.lock", "w") as lock:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            try:
+                if not (entry / "meta.json").exists():
+                    logger.info(f"[+] Cache miss, synthesizing {tlsf_file}")
+                    recorder = recorder or spans.Recorder()
+                    _fill(Path(tlsf_file), entry, timeout, recorder, params)
+            finally:
+                fcntl.flock(lock, fcntl.LOCK_UN)
+
+    meta = json.loads((entry / "meta.json").read_text())
+    system = spot.automaton(str(entry / "system.hoa"))
+    meta["hoa"] = (entry / "system.hoa").read_text()
+    auto.reserve_bdd_nodes(system)
+
+    _loaded[key] = (system, meta)
+    return system, meta
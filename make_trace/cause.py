@@ -1,22 +1,67 @@
 """This module contains the algorithms for cause synthesis."""
 
+import time
+from contextlib import contextmanager
+
+import buddy
 import spot
 
-from . import auto
+from . import auto, spans, translation
 
 
-def synthesize(system, trace, effect_automaton_neg, limit_assumption, contingencies):
-    """Given a system as a automaton, a set of inputs (from the atomic propositions), a
-    trace in lasso-shape, and an effect as an automaton this function synthesizes the
-    cause property and returns it as a Büchi automaton."""
+# Postprocessing options per synthesis stage ("effect" for effect and property
+# translation, "inner" for the inner product, "final" for the cause itself).
+# "balanced" keeps the options CORP has always used, "fast" trades result size for
+# latency and "minimal" spends more effort on small intermediate automata.
+PROFILES = {
+    "fast": {
+        "effect": ("buchi", "state-based", "small", "low"),
+        "inner": ("buchi", "state-based", "low"),
+        "final": ("buchi", "state-based", "small", "low"),
+    },
+    "balanced": {
+        "effect": ("buchi", "state-based", "small", "high"),
+        "inner": ("buchi", "state-based", "low"),
+        "final": ("buchi", "state-based", "small", "high"),
+    },
+    "minimal": {
+        "effect": ("buchi", "state-based", "small", "high"),
+        "inner": ("buchi", "state-based", "small", "high"),
+        "final": ("buchi", "state-based", "small", "high"),
+    },
+}
+
+
+# Default bound on the states of a single complementation (see Deadline).
+MAX_COMPLEMENT_STATES = 100000
+
+
+class Deadline:
+    """Cooperative cancellation token for cause synthesis.
+
+    The synthesis stages call check() around every expensive Spot operation
+    (product, postprocess, complement), which raises TimeoutError once the deadline
+    has passed. Spot's calls themselves cannot be interrupted, so a stage that is
+    already running finishes first; max_states additionally bounds the size of the
+    complement, which Spot aborts on its own.
+    """
+
+    def __init__(self, timeout=None, max_states=None):
+        self.end = None if timeout is None else time.monotonic() + timeout
+        self.aborter = None
+        if max_states is not None:
+            self.aborter = spot.output_aborter(max_states, 4 * max_states)
+
+    def expired(self):
+        return self.end is not None and time.monotonic() >= self.end
 
-    outputs = spot.get_synthesis_output_aps(system)
-    inputs = set(str(a) for a in system.ap()).difference(set(str(p) for p in outputs))
+    def check(self, stage):
+        if self.expired():
+            raise TimeoutError(f"deadline passed before {stage}")
 
-    if contingencies:
-        system = auto.construct_counterfactual_automaton(system, trace)
 
-    # Construct distance metric.
+def distance_formula(inputs, limit_assumption):
+    """Builds the LTL distance metric relating the actual, close and far inputs."""
     distance_metric = "G (True"
     for i in inputs:
         distance_metric += (
@@ -44,40 +89,404 @@ def synthesize(system, trace, effect_automaton_neg, limit_assumption, contingenc
                 + distance_metric
             )
     distance_metric += ")"
-    distance_automaton = spot.translate(spot.formula(distance_metric))
-
-    # Add suffixes to effect.
-    effect_automaton_neg = auto.add_suffix(effect_automaton_neg, "_close")
-
-    # Intersect effect and distance metric.
-    intersection = spot.product(distance_automaton, effect_automaton_neg)
-
-    # Construct NBA for inner product.
-    inner_product = spot.postprocess(
-        spot.product(auto.add_suffix(system, "_close"), intersection),
-        "buchi",
-        "state-based",
-        "low",
-    )
-
-    # Project close APs existentially.
-    after_projection = auto.project_existentially(
-        inner_product, [str(a) + "_close" for a in system.ap()]
-    )
-
-    # Central complementation.
-    intermediate_result = spot.complement(after_projection)
-
-    # Intersect with actual trace and project away APs
-    actual_trace = auto.add_suffix(trace.as_automaton(), "_actual")
-    actual_result = spot.product(intermediate_result, actual_trace)
-    actual_projection = auto.project_existentially(
-        actual_result, [str(a) + "_actual" for a in system.ap()]
-    )
-
-    intermediate_result = spot.postprocess(
-        actual_projection, "buchi", "state-based", "small", "high"
-    )
-
-    # Map APs back to inputs by removing the dummy suffix.
-    return auto.remove_suffix(intermediate_result, "_far")
+    return distance_metric
+
+
+def is_concrete(trace, system):
+    """Checks whether every letter of the trace fixes the value of every AP of the
+    system, i.e., whether the lasso denotes exactly one word."""
+    variables = [buddy.bdd_ithvar(system.register_ap(a)) for a in system.ap()]
+    for letter in list(trace.prefix) + list(trace.cycle):
+        for v in variables:
+            if (
+                buddy.bdd_and(letter, v) != buddy.bddfalse
+                and buddy.bdd_and(letter, buddy.bdd_not(v)) != buddy.bddfalse
+            ):
+                return False
+    return True
+
+
+# System-distance products already built by this process, shared by all
+# Synthesizers (i.e. all runs) on the same system.
+_system_distance = {}
+
+
+class Synthesizer:
+    """Cause synthesis for one system and trace, answering many effect queries.
+
+    Everything that does not depend on the effect (the optional counterfactual
+    automaton, the suffixed system, the distance metric and its product with the
+    system, and the suffixed trace) is built once on construction.
+
+    With lazy set and a concrete trace, the central complementation is applied to
+    after_projection restricted to the trace, so only the states the lasso reaches
+    are ever complemented. Traces with symbolic letters (such as cycle{1}) fall
+    back to the full construction.
+
+    The postprocessing effort of each stage follows the given profile (see
+    PROFILES). Every stage is recorded as a span on the given recorder, and the
+    sizes of the intermediate automata of the last query are kept in sizes.
+    """
+
+    def __init__(
+        self,
+        system,
+        trace,
+        limit_assumption,
+        contingencies,
+        deadline=None,
+        lazy=False,
+        profile="balanced",
+        recorder=None,
+    ):
+        self.deadline = deadline or Deadline()
+        self.recorder = recorder or spans.Recorder()
+        self.options = PROFILES[profile]
+        # (states, edges) of each intermediate automaton of the last query.
+        self.sizes = {}
+        outputs = spot.get_synthesis_output_aps(system)
+        self.inputs = set(str(a) for a in system.ap()).difference(
+            set(str(p) for p in outputs)
+        )
+
+        if contingencies:
+            with self.stage("counterfactual") as st:
+                system = st.automaton(
+                    auto.construct_counterfactual_automaton(system, trace)
+                )
+        self.system = system
+
+        # Construct distance metric.
+        with self.stage("distance automaton") as st:
+            self.distance_automaton = st.automaton(
+                translation.translate(
+                    distance_formula(sorted(self.inputs), limit_assumption)
+                )
+            )
+
+        # Intersect the system with the distance metric once for all effects (and,
+        # unless the system is a fresh counterfactual one, for all traces).
+        with self.stage("system-distance product") as st:
+            key = (id(system), limit_assumption)
+            warm = _system_distance.get(key)
+            if warm is None or warm[0] is not system:
+                product = spot.product(
+                    auto.add_suffix(system, "_close"), self.distance_automaton
+                )
+                # Out-edges of the product, fetched lazily and shared by all
+                # shifted effects.
+                warm = (system, product, {})
+                if not contingencies:
+                    _system_distance[key] = warm
+            _, self.system_distance, self.succ = warm
+            st.automaton(self.system_distance)
+        self.close_aps = [str(a) + "_close" for a in system.ap()]
+
+        # Suffix the actual trace.
+        self.trace = trace
+        self.actual_trace = auto.add_suffix(trace.as_automaton(), "_actual")
+        self.actual_aps = [str(a) + "_actual" for a in system.ap()]
+
+        # Lazy complementation is only sound if the trace denotes a single word.
+        self.lazy = lazy
+        self.concrete = is_concrete(trace, system)
+
+    @contextmanager
+    def stage(self, name):
+        """Wraps one synthesis stage: checks the deadline before it starts, records
+        a span for it and remembers the size of its automaton."""
+        self.deadline.check(name)
+        with self.recorder.span(name) as span:
+            yield span
+        if "states" in span:
+            self.sizes[name] = (span["states"], span["edges"])
+
+    def new_query(self):
+        """Resets sizes to the shared system-distance product for the next query."""
+        self.sizes = {
+            "system-distance product": (
+                self.system_distance.num_states(),
+                self.system_distance.num_edges(),
+            )
+        }
+
+    def synthesize(self, effect_automaton_neg):
+        """Synthesizes the cause of the effect (given negated, as an automaton) and
+        returns it as a Büchi automaton."""
+        return self.finish(self.effect_product(effect_automaton_neg))
+
+    def effect_product(self, effect_automaton_neg):
+        """Builds the product of the suffixed system, the distance metric and the
+        negated effect."""
+        self.new_query()
+
+        # Add suffixes to effect.
+        effect_automaton_neg = auto.add_suffix(effect_automaton_neg, "_close")
+
+        with self.stage("product") as st:
+            return st.automaton(
+                spot.product(self.system_distance, effect_automaton_neg)
+            )
+
+    def synthesize_shifted(self, output, offsets=None):
+        """Synthesizes the causes of the time-shifted effects X^i output for all given
+        offsets i (by default every timestep at which the trace sets output).
+
+        No effect automaton is translated: the product with the negated effect
+        X^i !output is the system-distance product unrolled for i steps, with the
+        output check on the edges leaving the last layer. The unrolling is built
+        once, for the largest offset, and every offset's product is cut out of it.
+        Returns an iterator of (offset, Büchi automaton) pairs in the order of
+        offsets, whose causes are synthesized as it is advanced, so a caller that
+        runs out of time keeps the causes of the earlier offsets.
+        """
+        if offsets is None:
+            offsets = self.output_timesteps(output)
+        offsets = list(offsets)
+        if not offsets:
+            return iter(())
+        with self.stage("shifted product") as st:
+            unrolled, init = self.unroll(output, offsets)
+            st.automaton(unrolled)
+        return (
+            (i, self.finish(self.shifted_product(unrolled, init[i]))) for i in offsets
+        )
+
+    def output_timesteps(self, output):
+        """Returns the positions of the trace lasso at which output is set."""
+        obdd = buddy.bdd_ithvar(self.system.register_ap(output))
+        letters = list(self.trace.prefix) + list(self.trace.cycle)
+        return [
+            i
+            for i, letter in enumerate(letters)
+            if buddy.bdd_and(letter, buddy.bdd_not(obdd)) == buddy.bddfalse
+        ]
+
+    def successors(self, state):
+        """Returns the (memoized) out-edges of a state of the system-distance
+        product."""
+        edges = self.succ.get(state)
+        if edges is None:
+            edges = [(e.cond, e.dst, e.acc) for e in self.system_distance.out(state)]
+            self.succ[state] = edges
+        return edges
+
+    def successors(self, state):
+        """Returns the (memoized) out-edges of a state of the system-distance
+        product."""
+        edges = self.succ.get(state)
+        if edges is None:
+            edges = [(e.cond, e.dst, e.acc) for e in self.system_distance.out(state)]
+            self.succ[state] = edges
+        return edges
+
+    def shifted_product(self, unrolled, init):
+        """Cuts the product of the system, the distance metric and one negated
+        effect X^offset !output out of the unrolling (see unroll)."""
+        self.new_query()
+        with self.stage("product") as st:
+            product = spot.make_twa_graph(unrolled, spot.twa_prop_set.all())
+            product.set_init_state(init)
+            product.purge_unreachable_states()
+            return st.automaton(product)
+
+    def unroll(self, output, offsets):
+        """Unrolls the system-distance product for all offsets at once and returns
+        it with the state at which each offset's product starts.
+
+        Layer k holds the states from which !output is checked k steps later, so
+        the product of offset i is the part reachable from the initial state in
+        layer i, and the layers are shared by all offsets.
+        """
+        base = self.system_distance
+        neg = buddy.bdd_not(buddy.bdd_ithvar(base.register_ap(output + "_close")))
+
+        result = spot.make_twa_graph(base.get_dict())
+        result.copy_ap_of(base)
+        result.copy_acceptance_of(base)
+
+        # Virtual states are (state, layer) pairs, layer None standing for every
+        # position after the effect was checked.
+        smap = {}
+
+        def lookup(state, layer):
+            pair = (state, layer)
+            p = smap.get(pair)
+            if p is None:
+                p = result.new_state()
+                smap[pair] = p
+                todo.append(pair)
+            return p
+
+        todo = []
+        init = {i: lookup(base.get_init_state_number(), i) for i in offsets}
+        result.set_init_state(init[offsets[0]])
+        expanded = 0
+        while todo:
+            expanded += 1
+            if expanded % 1024 == 0:
+                self.deadline.check("shifted product")
+            q, layer = todo.pop()
+            src = smap[(q, layer)]
+            for cond, dst, acc in self.successors(q):
+                if layer == 0:
+                    cond = buddy.bdd_and(cond, neg)
+                    if cond == buddy.bddfalse:
+                        continue
+                nxt = None if layer is None or layer == 0 else layer - 1
+                result.new_edge(src, lookup(dst, nxt), cond, acc)
+
+        return result, init
+
+    def complement(self, automaton):
+        """Complements the automaton within the state budget of the deadline."""
+        with self.stage("complement") as st:
+            if self.deadline.aborter is None:
+                return st.automaton(spot.complement(automaton))
+            result = spot.complement(automaton, self.deadline.aborter)
+            if result is None:
+                raise TimeoutError("complement exceeded the state budget")
+            return st.automaton(result)
+
+    def project(self, product):
+        """Postprocesses the product of the suffixed system, the distance metric and
+        the negated effect and projects away the close APs.
+
+        Along an actual trace u, the causes are the far inputs f with (u, f)
+        outside of the result.
+        """
+
+        # Construct NBA for inner product.
+        with self.stage("inner postprocess") as st:
+            inner_product = st.automaton(
+                spot.postprocess(product, *self.options["inner"])
+            )
+
+        # Project close APs existentially.
+        with self.stage("projection") as st:
+            return st.automaton(
+                auto.project_existentially(inner_product, self.close_aps)
+            )
+
+    def restrict(self, after_projection):
+        """Returns the far inputs f with (u, f) inside of after_projection, for the
+        actual trace u."""
+        with self.stage("actual product") as st:
+            return st.automaton(
+                auto.project_existentially(
+                    spot.product(after_projection, self.actual_trace), self.actual_aps
+                )
+            )
+
+    def finish(self, product):
+        """Runs the effect-dependent stages on the product of the suffixed system,
+        the distance metric and the negated effect."""
+        after_projection = self.project(product)
+
+        if self.lazy and self.concrete:
+            return self.finish_lazy(after_projection)
+
+        # Central complementation.
+        intermediate_result = self.complement(after_projection)
+
+        # Intersect with actual trace and project away APs
+        with self.stage("actual product") as st:
+            actual_result = spot.product(intermediate_result, self.actual_trace)
+            actual_projection = st.automaton(
+                auto.project_existentially(actual_result, self.actual_aps)
+            )
+
+        with self.stage("final postprocess") as st:
+            intermediate_result = st.automaton(
+                spot.postprocess(actual_projection, *self.options["final"])
+            )
+
+        # Map APs back to inputs by removing the dummy suffix.
+        return auto.remove_suffix(intermediate_result, "_far")
+
+    def finish_lazy(self, after_projection):
+        """Complements only the part of after_projection that the actual trace
+        reaches.
+
+        For a concrete lasso u, the far inputs f with (u, f) outside of
+        after_projection are exactly the complement of the far inputs with (u, f)
+        inside. We therefore restrict after_projection to the trace first and
+        complement that much smaller automaton, instead of complementing
+        after_projection as a whole and intersecting with the trace afterwards.
+        """
+        restricted = self.restrict(after_projection)
+
+        # Nothing is excluded along the trace, so every far input is a cause.
+        if restricted.is_empty():
+            return spot.translate(spot.formula.tt(), dict=self.system.get_dict())
+
+        intermediate_result = self.complement(restricted)
+
+        with self.stage("final postprocess") as st:
+            intermediate_result = st.automaton(
+                spot.postprocess(intermediate_result, *self.options["final"])
+            )
+
+        # Map APs back to inputs by removing the dummy suffix.
+        return auto.remove_suffix(intermediate_result, "_far")
+
+    def check(self, effect_automaton_neg, hypotheses):
+        """Decides for each (hypothesis, negated hypothesis) pair of automata over
+        the inputs whether the hypothesis is the cause of the effect (given
+        negated), returning one bool per pair.
+
+        For a concrete trace, the cause is the complement of the restricted
+        after_projection R, so neither the cause nor its complement is built for
+        most hypotheses:
+        - hypothesis ⊆ cause iff the hypothesis does not intersect R, an on-the-fly
+          emptiness check;
+        - cause ⊆ hypothesis iff the negated hypothesis is included in R, which
+          holds if R simulates it. Only if the simulation fails is R complemented,
+          once for all hypotheses, and intersected with the negated hypothesis.
+        Traces with symbolic letters fall back to synthesizing the cause once and
+        comparing every hypothesis against it.
+        """
+        product = self.effect_product(effect_automaton_neg)
+        if not self.concrete:
+            result = self.finish(product)
+            with self.stage("equivalence"):
+                return [h.equivalent_to(result) for h, _ in hypotheses]
+
+        restricted = self.restrict(self.project(product))
+        complement = None
+        verdicts = []
+        for hypothesis, negated in hypotheses:
+            with self.stage("hypothesis intersection"):
+                if auto.add_suffix(hypothesis, "_far").intersects(restricted):
+                    verdicts.append(False)
+                    continue
+
+            negated = auto.add_suffix(negated, "_far")
+            with self.stage("simulation"):
+                simulated = auto.is_simulated(negated, restricted)
+            if simulated:
+                verdicts.append(True)
+                continue
+
+            if complement is None:
+                complement = self.complement(restricted)
+            with self.stage("cause intersection"):
+                verdicts.append(not negated.intersects(complement))
+        return verdicts
+
+
+def synthesize(
+    system,
+    trace,
+    effect_automaton_neg,
+    limit_assumption,
+    contingencies,
+    lazy=False,
+    profile="balanced",
+):
+    """Given a system as a automaton, a set of inputs (from the atomic propositions), a
+    trace in lasso-shape, and an effect as an automaton this function synthesizes the
+    cause property and returns it as a Büchi automaton."""
+    return Synthesizer(
+        system, trace, limit_assumption, contingencies, lazy=lazy, profile=profile
+    ).synthesize(effect_automaton_neg)
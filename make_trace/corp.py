@@ -3,12 +3,240 @@
 """Main module that exposes the command line interface."""
 
 import getopt
+import json
+import multiprocessing
 import sys
+import time
+from multiprocessing.connection import wait
+from pathlib import Path
 
-import cause
-import parse
 import spot
 
+from . import cause, parse, schedule, spans
+
+# Systems and negated effects parsed by this process, keyed by file (and profile).
+_systems = {}
+_effects = {}
+
+
+def print_stats(synthesizer):
+    for stage, (states, edges) in synthesizer.sizes.items():
+        print(f"{stage}: {states} states, {edges} edges", file=sys.stderr)
+
+
+def hypothesis_files(candidatefile):
+    """Returns the hypothesis file, or the visible files of a directory of
+    hypotheses."""
+    path = Path(candidatefile)
+    if path.is_dir():
+        return sorted(
+            f for f in path.iterdir() if f.is_file() and not f.name.startswith(".")
+        )
+    return [path]
+
+
+def check(synthesizer, effect, candidatefile, profile):
+    """Checks one hypothesis file, or every file of a directory of hypotheses,
+    without synthesizing the cause, and returns the verdict of each file: a bool,
+    or the error of a file that could not be parsed as a hypothesis."""
+    verdicts = {}
+    parsed = {}
+    for f in hypothesis_files(candidatefile):
+        try:
+            parsed[f] = (
+                parse.propertyfile(str(f), profile),
+                parse.effectfile(str(f), profile),
+            )
+        except Exception as e:
+            verdicts[f] = f"error: {type(e).__name__}: {e}"
+    if parsed:
+        verdicts.update(zip(parsed, synthesizer.check(effect, list(parsed.values()))))
+    return dict(sorted(verdicts.items()))
+
+
+def load_system(sysfile):
+    if sysfile not in _systems:
+        _systems[sysfile] = spot.automaton(sysfile)
+    return _systems[sysfile]
+
+
+def load_effect(effectfile, profile):
+    key = (effectfile, profile)
+    if key not in _effects:
+        _effects[key] = parse.effectfile(effectfile, profile)
+    return _effects[key]
+
+
+def job_record(job):
+    return {k: job[k] for k in ("id", "system", "effect", "trace") if k in job}
+
+
+def run_job(job, synthesizers, defaults, timeout, max_states=None):
+    """Runs one manifest entry and returns its result record.
+
+    Synthesizers are shared by all jobs on the same trace and configuration (and,
+    through the system-distance memo, by all jobs on the same system); each job
+    gets its own deadline of timeout seconds and max_states complement states.
+    """
+    options = dict(defaults, **job)
+    profile = options["profile"]
+    record = job_record(job)
+    recorder = spans.Recorder()
+    deadline = cause.Deadline(timeout, max_states)
+    start = time.perf_counter()
+    try:
+        with recorder.span("parse"):
+            system = load_system(job["system"])
+            effect = load_effect(job["effect"], profile)
+            trace = parse.tracefile(job["trace"])
+
+        key = (
+            job["trace"],
+            options["contingencies"],
+            options["assumelimit"],
+            options["lazy"],
+            profile,
+        )
+        if key not in synthesizers:
+            synthesizers[key] = cause.Synthesizer(
+                system,
+                trace,
+                options["assumelimit"],
+                options["contingencies"],
+                deadline=deadline,
+                lazy=options["lazy"],
+                profile=profile,
+                recorder=recorder,
+            )
+        synthesizer = synthesizers[key]
+        synthesizer.deadline = deadline
+        synthesizer.recorder = recorder
+
+        if "check" in job and "output" not in job:
+            verdicts = check(synthesizer, effect, job["check"], profile)
+            record["verdicts"] = {str(f): v for f, v in verdicts.items()}
+        else:
+            result = synthesizer.synthesize(effect)
+            record["cause"] = not result.is_empty()
+            if "output" in job:
+                result.save(job["output"])
+            if "check" in job:
+                candidate = parse.propertyfile(job["check"], profile)
+                record["verdicts"] = {job["check"]: candidate.equivalent_to(result)}
+        record["error"] = None
+    except Exception as e:
+        record["error"] = f"{type(e).__name__}: {e}"
+    record["wall"] = time.perf_counter() - start
+    record["stages"] = {
+        stage: stats["total_wall"]
+        for stage, stats in spans.summarize(recorder.spans).items()
+    }
+    return record
+
+
+def run_group(conn, jobs, defaults, timeout, max_states):
+    """Runs all jobs on one system in order, sending each result record through
+    conn as soon as its job is done."""
+    synthesizers = {}
+    try:
+        for job in jobs:
+            conn.send(run_job(job, synthesizers, defaults, timeout, max_states))
+    finally:
+        conn.close()
+
+
+def batch(manifestfile, outputfile, n_jobs, defaults, timeout, max_states):
+    """Runs every (system, trace, effect) job of a JSONL manifest, grouped by
+    system, and streams one JSONL result record per job to outputfile (or stdout).
+
+    Each group runs in one forked worker, so its system is parsed and its effects
+    are translated once; up to n_jobs groups run in parallel. A worker that
+    overruns the timeouts of its jobs like a scheduler worker would (see
+    schedule.HARD_FACTOR) is killed; the jobs a killed or crashed worker did not
+    finish get an error record.
+    """
+    groups = {}
+    with open(manifestfile, "r", encoding="utf-8") as f:
+        for n, line in enumerate(f):
+            if line.strip():
+                job = json.loads(line)
+                job.setdefault("id", n)
+                groups.setdefault(job["system"], []).append(job)
+    # Largest groups first, so that they do not end up last on a single worker.
+    work = sorted(groups.values(), key=len, reverse=True)
+
+    out = open(outputfile, "w", encoding="utf-8") if outputfile else sys.stdout
+    try:
+        if n_jobs > 1:
+            run_workers(out, work, n_jobs, defaults, timeout, max_states)
+        else:
+            # Without workers, write every record as soon as its job is done.
+            for jobs in work:
+                synthesizers = {}
+                for job in jobs:
+                    record = run_job(job, synthesizers, defaults, timeout, max_states)
+                    write_records(out, [record])
+    finally:
+        if out is not sys.stdout:
+            out.close()
+
+
+def run_workers(out, work, n_jobs, defaults, timeout, max_states):
+    """Runs the groups of work on up to n_jobs forked workers (see batch)."""
+    ctx = multiprocessing.get_context("fork")
+    pending = list(work)
+    # receiver -> (worker, jobs without a record yet, kill time)
+    running = {}
+
+    def finish(receiver, error):
+        worker, left, _ = running.pop(receiver)
+        if worker.is_alive():
+            worker.kill()
+        worker.join()
+        receiver.close()
+        if left:
+            error = error or f"worker died (exit code {worker.exitcode})"
+            write_records(out, [dict(job_record(job), error=error) for job in left])
+
+    while pending or running:
+        while pending and len(running) < n_jobs:
+            jobs = pending.pop(0)
+            receiver, sender = ctx.Pipe(duplex=False)
+            worker = ctx.Process(
+                target=run_group, args=(sender, jobs, defaults, timeout, max_states)
+            )
+            worker.start()
+            sender.close()
+            limit = None
+            if timeout is not None:
+                budget = schedule.HARD_FACTOR * timeout * len(jobs)
+                limit = time.monotonic() + budget + schedule.HARD_GRACE
+            running[receiver] = (worker, list(jobs), limit)
+
+        limits = [limit for _, _, limit in running.values() if limit is not None]
+        wait_for = max(0, min(limits) - time.monotonic()) if limits else None
+        for receiver in wait(list(running), wait_for):
+            try:
+                record = receiver.recv()
+            except EOFError:
+                # The group is done, or its worker died before finishing it.
+                finish(receiver, None)
+                continue
+            # Records arrive in the order of the jobs of the group.
+            running[receiver][1].pop(0)
+            write_records(out, [record])
+
+        now = time.monotonic()
+        for receiver, (_, left, limit) in list(running.items()):
+            if limit is not None and now >= limit:
+                finish(receiver, "TimeoutError: worker overran its timeout, killed")
+
+
+def write_records(out, records):
+    for record in records:
+        out.write(json.dumps(record) + "\n")
+    out.flush()
+
 
 def main(argv):
     sysfile = ""
@@ -16,23 +244,59 @@ def main(argv):
     tracefile = ""
     contingencies = False
     limitassumption = False
+    lazy = False
+    profile = "balanced"
+    showstats = False
     causecheck = False
+    outputfile = ""
+    manifestfile = ""
+    n_jobs = 1
+    timeout = None
+    max_states = None
     usage = """Usage: corp.py -s <systemfile> -e <effectfile> -t <tracefile> \
-    -o <outputfile> [options]"""
+    -o <outputfile> [options]
+       corp.py --batch=<manifest> [-o <resultfile>] [options]"""
 
     options = """Options are:
         --contingencies, -c
             toggles the inclusion of contingencies.
         --assumelimit, -a
             uses the distance metric that satisfies the limit assumption.
+        --lazy, -l
+            complements only the part of the system the trace reaches (requires
+            a trace whose letters fix every AP; falls back otherwise).
+        --profile=<fast|balanced|minimal>
+            selects the postprocessing effort of each synthesis stage
+            (default: balanced).
+        --stats
+            prints the size of each intermediate automaton to stderr.
+        --check=<hypothesis file or directory>
+            decides whether the hypothesis (or each hypothesis in the directory)
+            is the cause, by inclusion checks that never build the cause. With
+            -o, the cause is synthesized and saved as well, and compared against
+            a single hypothesis.
+        --batch=<manifest>
+            runs every job of a JSONL manifest of {"system", "effect", "trace"}
+            entries (optionally with "id", "output", "check", "contingencies",
+            "assumelimit" and "lazy", which default to the options given here)
+            and writes one JSONL result per job, with its wall time per stage,
+            to the -o file or stdout.
+        --jobs=<n>
+            number of processes of a batch; jobs on the same system share one
+            (default: 1).
+        --timeout=<seconds>
+            time budget of each batch job (default: none).
+        --max-states=<n>
+            state budget of every complementation (default: %d for batch jobs,
+            none otherwise).
     """
 
-    man = "%s\n\n%s" % (usage, options)
+    man = "%s\n\n%s" % (usage, options % cause.MAX_COMPLEMENT_STATES)
 
     try:
         opts, args = getopt.getopt(
             argv,
-            "hs:e:t:o:ca",
+            "hs:e:t:o:cal",
             [
                 "help",
                 "system=",
@@ -41,7 +305,14 @@ def main(argv):
                 "output=",
                 "contingencies",
                 "assumelimit",
+                "lazy",
+                "profile=",
+                "stats",
                 "check=",
+                "batch=",
+                "jobs=",
+                "timeout=",
+                "max-states=",
             ],
         )
     except getopt.GetoptError:
@@ -64,20 +335,73 @@ def main(argv):
             contingencies = True
         elif opt in ("-a", "--assumelimit"):
             limitassumption = True
+        elif opt in ("-l", "--lazy"):
+            lazy = True
+        elif opt == "--profile":
+            if arg not in cause.PROFILES:
+                print(man)
+                sys.exit(2)
+            profile = arg
+        elif opt == "--stats":
+            showstats = True
         elif opt in ("--check"):
             causecheck = True
             candidatefile = arg
+        elif opt == "--batch":
+            manifestfile = arg
+        elif opt == "--jobs":
+            n_jobs = int(arg)
+        elif opt == "--timeout":
+            timeout = int(arg)
+        elif opt == "--max-states":
+            max_states = int(arg)
+
+    if manifestfile:
+        defaults = {
+            "contingencies": contingencies,
+            "assumelimit": limitassumption,
+            "lazy": lazy,
+            "profile": profile,
+        }
+        if max_states is None:
+            max_states = cause.MAX_COMPLEMENT_STATES
+        batch(manifestfile, outputfile, n_jobs, defaults, timeout, max_states)
+        exit(0)
 
     system = spot.automaton(sysfile)
-    effect = parse.effectfile(effectfile)
+    effect = parse.effectfile(effectfile, profile)
     trace = parse.tracefile(tracefile)
 
-    result = cause.synthesize(system, trace, effect, limitassumption, contingencies)
+    synthesizer = cause.Synthesizer(
+        system,
+        trace,
+        limitassumption,
+        contingencies,
+        deadline=cause.Deadline(max_states=max_states),
+        lazy=lazy,
+        profile=profile,
+    )
+
+    if causecheck and not outputfile:
+        verdicts = check(synthesizer, effect, candidatefile, profile)
+        for f, verdict in verdicts.items():
+            if isinstance(verdict, str):
+                line = verdict
+            else:
+                line = "Is cause." if verdict else "No cause."
+            print(f"{f.name}: {line}" if Path(candidatefile).is_dir() else line)
+        if showstats:
+            print_stats(synthesizer)
+        exit(0)
+
+    result = synthesizer.synthesize(effect)
+    if showstats:
+        print_stats(synthesizer)
     if result.is_empty():
         if not causecheck:
             print("No cause exists.")
             exit(0)
-        candidate = parse.propertyfile(candidatefile)
+        candidate = parse.propertyfile(candidatefile, profile)
         if candidate.is_empty():
             print("Is cause.")
             exit(0)
@@ -89,7 +413,7 @@ def main(argv):
         if not causecheck:
             print("Cause found by CORP.")
             exit(0)
-        candidate = parse.propertyfile(candidatefile)
+        candidate = parse.propertyfile(candidatefile, profile)
         if candidate.equivalent_to(result):
             print("Is cause.")
             exit(0)
@@ -0,0 +1,119 @@
+"""This module detects duplicate traces of a spec across runs, workers and jobs, so
+that cause synthesis runs once per distinct trace.
+
+Traces are canonicalized as Spot words and recorded in an append-only
+``traces.jsonl`` next to the spec's cached system. An entry ``{"key", "job", "run"}``
+claims a trace for a job when its run starts, so other runs of the same job see it
+as a duplicate (retries of the claiming run do not); an entry ``{"key",
+"causality"}`` stores its finished causality result, which any later job may
+reuse.
+"""
+
+import fcntl
+import hashlib
+import json
+import uuid
+
+import spot
+
+from . import cache
+
+MODES = ("reuse", "skip", "off")
+
+# Trace sets already opened by this process, keyed by (spec key, profile, job).
+_sets = {}
+# Job id of runs that are not part of a job.
+_process_job = f"process-{uuid.uuid4().hex}"
+
+
+def canonical(trace: str):
+    """Returns the canonical form of a lasso word.
+
+    Simplification rolls the prefix into the cycle and minimizes the cycle, so
+    traces that denote the same infinite word get the same form.
+    """
+    word = spot.parse_word(trace)
+    word.simplify()
+    return str(word)
+
+
+class TraceSet:
+    """The traces one job has seen so far for one spec (under one cause-synthesis
+    profile), and the causality results known for any trace of the spec."""
+
+    def __init__(self, path, profile, job):
+        self.path = path
+        self.profile = profile
+        self.job = job
+        # key -> run that claimed it in this job
+        self.claimed = {}
+        self.results = {}
+        self.offset = 0
+
+    def key(self, trace: str, effects_config=(0, False)):
+        """Returns the key of a trace under the effects settings (window,
+        conjunctions, see effects.load_config) that decide which effects its
+        causality result covers."""
+        window, conjunctions = effects_config
+        text = f"{self.profile}\n{window}\n{conjunctions}\n{canonical(trace)}"
+        return hashlib.sha256(text.encode("utf-8")).hexdigest()
+
+    def refresh(self, f):
+        """Reads the entries other processes appended since the last call."""
+        f.seek(self.offset)
+        for line in f:
+            if not line.endswith(b"\n"):
+                break
+            self.offset += len(line)
+            entry = json.loads(line)
+            if entry.get("job") == self.job:
+                self.claimed.setdefault(entry["key"], entry.get("run"))
+            if "causality" in entry:
+                self.results.setdefault(entry["key"], entry["causality"])
+
+    def claim(self, key, run=None):
+        """Marks the trace as seen by run and returns (duplicate, cached causality
+        or None).
+
+        A trace is only a duplicate if another run of the job claimed it, so that a
+        retried run that samples its trace again is not skipped. The causality
+        result stored by any job is returned either way.
+        """
+        with open(self.path, "a+b") as f:
+            fcntl.flock(f, fcntl.LOCK_EX)
+            try:
+                self.refresh(f)
+                if key in self.claimed:
+                    return self.claimed[key] != run, self.results.get(key)
+                entry = {"key": key, "job": self.job, "run": run}
+                f.write(json.dumps(entry).encode("utf-8") + b"\n")
+                f.flush()
+                self.refresh(f)
+                return False, self.results.get(key)
+            finally:
+                fcntl.flock(f, fcntl.LOCK_UN)
+
+    def store(self, key, causality):
+        """Stores the finished causality result of a trace for later duplicates."""
+        entry = {"key": key, "causality": causality}
+        with open(self.path, "ab") as f:
+            fcntl.flock(f, fcntl.LOCK_EX)
+            try:
+                f.write(json.dumps(entry).encode("utf-8") + b"\n")
+            finally:
+                fcntl.flock(f, fcntl.LOCK_UN)
+        self.results.setdefault(key, causality)
+
+
+def trace_set(tlsf_file, profile="balanced", job=None):
+    """Returns the (process-wide) trace set of a cached spec for a job.
+
+    All workers of a job must pass the same job id; without one, duplicates are
+    only detected within this process.
+    """
+    job = job or _process_job
+    key = (cache.spec_key(tlsf_file), profile, job)
+    if key not in _sets:
+        path = cache.CACHE_DIR / key[0] / "traces.jsonl"
+        _sets[key] = TraceSet(path, profile, job)
+    return _sets[key]
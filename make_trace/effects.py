@@ -0,0 +1,101 @@
+"""This module extracts the effects of a trace (the outputs it sets, and optionally
+compound patterns of them) as compact descriptors, by evaluating each letter of the
+parsed lasso against the BDD of every output."""
+
+import tomllib
+from pathlib import Path
+from typing import NamedTuple
+
+import buddy
+import spot
+
+
+class Effect(NamedTuple):
+    """An effect of a trace: with kind "at", outputs[0] holds at timestep; with
+    "and", all outputs hold at timestep; with "G" (resp. "F"), outputs[0] holds at
+    every (resp. some) position of the window steps following timestep."""
+
+    outputs: tuple
+    timestep: int
+    kind: str = "at"
+    window: int = 0
+
+    @property
+    def end(self):
+        """Returns the last timestep the effect talks about."""
+        return self.timestep + self.window
+
+    def formula(self):
+        """Returns the effect as an LTL formula of size independent of how far into
+        the trace it lies."""
+        if self.kind == "and":
+            body = "(" + " & ".join(self.outputs) + ")"
+        elif self.kind in ("F", "G"):
+            body = f"{self.kind}[0..{self.window}] {self.outputs[0]}"
+        else:
+            body = self.outputs[0]
+        return f"X[{self.timestep}] {body}" if self.timestep else body
+
+    def label(self):
+        """Returns the name of the effect in records and effects files; single
+        outputs keep their X-prefixed form."""
+        if self.kind == "at":
+            return f"{'X' * self.timestep} {self.outputs[0]}"
+        return self.formula()
+
+
+def load_config(config_file: Path):
+    """Read the compound effect settings (window, conjunctions) from the [effects]
+    table of a config; both are off by default."""
+    with open(config_file, "rb") as f:
+        config = tomllib.load(f).get("effects", {})
+    return config.get("window", 0), config.get("conjunctions", False)
+
+
+def lasso_letter(trace, i):
+    """Return the letter at position i of a lasso-shaped spot.twa_word."""
+    if i < len(trace.prefix):
+        return trace.prefix[i]
+    return trace.cycle[(i - len(trace.prefix)) % len(trace.cycle)]
+
+
+def extract(word, outputs, window=0, conjunctions=False):
+    """Returns the effects of a spot.twa_word, ordered by timestep.
+
+    Timesteps cover the prefix and one pass through the cycle of the lasso. An
+    output holds at a position if the letter there implies it, so outputs whose
+    names share a prefix are told apart and symbolic letters only count where they
+    fix the output. With a window, G effects of every output that holds for window
+    more steps and F effects of every output that does not hold yet but will within
+    window steps are added; with conjunctions, an "and" effect of all outputs that
+    hold together at a position.
+    """
+    length = len(word.prefix) + len(word.cycle)
+    variables = [
+        (o, spot.formula_to_bdd(spot.formula.ap(o), word.get_dict(), word))
+        for o in outputs
+    ]
+    holds = []
+    for i in range(length + window):
+        letter = lasso_letter(word, i)
+        holds.append(
+            [
+                o
+                for o, v in variables
+                if buddy.bdd_and(letter, buddy.bdd_not(v)) == buddy.bddfalse
+            ]
+        )
+
+    result = []
+    for i in range(length):
+        result.extend(Effect((o,), i) for o in holds[i])
+        if conjunctions and len(holds[i]) > 1:
+            result.append(Effect(tuple(holds[i]), i, "and"))
+        if window:
+            for o in outputs:
+                ahead = [o in h for h in holds[i + 1 : i + window + 1]]
+                if o in holds[i] and all(ahead):
+                    result.append(Effect((o,), i, "G", window))
+                elif o not in holds[i] and any(ahead):
+                    result.append(Effect((o,), i, "F", window))
+    return result
@@ -1,5 +1,8 @@
 import spot
 
+from . import translation
+from .cause import PROFILES
+
 """
 Parses the given counterexample trace;
 returns it as a tuple of lists over sets of APs.
@@ -16,19 +19,12 @@ Parses any property from the given file and handles both LTL formulas and HOA au
 """
 
 
-def propertyfile(filename):
+def propertyfile(filename, profile="balanced"):
+    options = PROFILES[profile]["effect"]
     try:
-        return spot.postprocess(
-            spot.automaton(filename), "buchi", "state-based", "small", "high"
-        )
+        return spot.postprocess(spot.automaton(filename), *options)
     except Exception:
-        return spot.postprocess(
-            spot.translate(spot.formula(open(filename).read())),
-            "buchi",
-            "state-based",
-            "small",
-            "high",
-        )
+        return translation.translate(open(filename).read(), *options)
 
 
 """
@@ -37,20 +33,9 @@ IMMEDIATELY NEGATES THE PROPERTY! (For runtime gains with formulas).
 """
 
 
-def effectfile(filename):
+def effectfile(filename, profile="balanced"):
+    options = PROFILES[profile]["effect"]
     try:
-        return spot.postprocess(
-            spot.complement(spot.automaton(filename)),
-            "buchi",
-            "state-based",
-            "small",
-            "high",
-        )
+        return spot.postprocess(spot.complement(spot.automaton(filename)), *options)
     except Exception:
-        return spot.postprocess(
-            spot.translate(spot.formula("!(" + open(filename).read() + ")")),
-            "buchi",
-            "state-based",
-            "small",
-            "high",
-        )
+        return translation.translate("!(" + open(filename).read() + ")", *options)
@@ -0,0 +1,240 @@
+"""This module samples random lasso traces directly from a synthesized system, taking
+the place of the hoax executor and the post-processing of its output.
+
+Besides hoax's uniform "flip" driver it offers a "coverage" driver that steers
+walks toward the edges of the system that earlier walks visited least.
+"""
+
+import random
+import tomllib
+from pathlib import Path
+
+import buddy
+import spot
+
+
+DRIVERS = ("flip", "coverage")
+
+# Coverage of the systems this process sampled, keyed by system identity.
+_coverage = {}
+
+
+def load_config(config_file: Path):
+    """Read the sampler settings (nondet, bound, seed, driver) from a hoax-style
+    config."""
+    with open(config_file, "rb") as f:
+        config = tomllib.load(f)
+    runner = config.get("runner", {})
+    driver = config.get("hoax", {}).get("default-driver", "flip")
+    return (
+        runner.get("nondet", "first"),
+        runner.get("bound", 10),
+        runner.get("seed"),
+        driver,
+    )
+
+
+def make_replacement(aps):
+    """Build replacement string for empty set() in hoax output."""
+    parts = [f"'!{ap}'" for ap in aps]
+    return "{" + ", ".join(parts) + "}"
+
+
+class Coverage:
+    """How often walks over a system visited each of its edges."""
+
+    def __init__(self):
+        # edge number -> number of visits
+        self.edges = {}
+
+    def visit(self, edge):
+        self.edges[edge] = self.edges.get(edge, 0) + 1
+
+
+def coverage_for(system):
+    """Returns the coverage this process has accumulated for a system."""
+    entry = _coverage.get(id(system))
+    if entry is None or entry[0] is not system:
+        entry = (system, Coverage())
+        _coverage[id(system)] = entry
+    return entry[1]
+
+
+class Sampler:
+    """Random walks over the edges of a Mealy machine.
+
+    At every step the driver draws the inputs, an edge whose guard is compatible
+    with them is chosen according to nondet ("first" or "random"), and the outputs
+    are fixed to a random assignment satisfying that guard. Walks stop after bound
+    steps or when no edge is enabled.
+
+    The "flip" driver draws inputs uniformly, like hoax's. The "coverage" driver
+    targets the out-edge that was visited least (preferring edges into states whose
+    own out-edges are least visited) and draws inputs from its guard, so walks
+    spread over the system instead of revisiting its most likely part. Visits are
+    recorded in coverage, which is shared by all samplers of a system in this
+    process unless given.
+    """
+
+    def __init__(
+        self,
+        system,
+        nondet="first",
+        bound=10,
+        seed=None,
+        driver="flip",
+        coverage=None,
+    ):
+        if nondet not in ("first", "random"):
+            raise ValueError(f"Unsupported nondet mode for sampling: {nondet}")
+        if driver not in DRIVERS:
+            raise ValueError(f"Unsupported driver for sampling: {driver}")
+
+        self.system = system
+        self.nondet = nondet
+        self.bound = bound
+        self.rng = random.Random(seed)
+        self.driver = driver
+        self.coverage = coverage or coverage_for(system)
+
+        outputs = set(str(o) for o in spot.get_synthesis_output_aps(system))
+        self.aps = [str(ap) for ap in system.ap()]
+        self.vars = [buddy.bdd_ithvar(system.register_ap(ap)) for ap in self.aps]
+        self.inputs = [v for ap, v in zip(self.aps, self.vars) if ap not in outputs]
+        self.output_cube = buddy.bddtrue
+        for ap, v in zip(self.aps, self.vars):
+            if ap in outputs:
+                self.output_cube = buddy.bdd_and(self.output_cube, v)
+
+        # Out-edges of every state, fetched once for all walks.
+        self.succ = [
+            [(e.cond, e.dst, system.edge_number(e)) for e in system.out(s)]
+            for s in range(system.num_states())
+        ]
+
+    def pick(self, guard):
+        """Return a random total assignment (one bool per AP) satisfying guard."""
+        values = []
+        for v in self.vars:
+            pos = buddy.bdd_and(guard, v)
+            neg = buddy.bdd_and(guard, buddy.bdd_not(v))
+            if pos == buddy.bddfalse:
+                value = False
+            elif neg == buddy.bddfalse:
+                value = True
+            else:
+                value = self.rng.random() < 0.5
+            guard = pos if value else neg
+            values.append(value)
+        return values
+
+    def pick_inputs(self, guard):
+        """Return a random input letter (a conjunction of input literals) that is
+        compatible with guard."""
+        letter = buddy.bddtrue
+        for v in self.inputs:
+            pos = buddy.bdd_and(guard, v)
+            neg = buddy.bdd_and(guard, buddy.bdd_not(v))
+            if pos == buddy.bddfalse:
+                lit = buddy.bdd_not(v)
+            elif neg == buddy.bddfalse or self.rng.random() < 0.5:
+                lit = v
+            else:
+                lit = buddy.bdd_not(v)
+            guard = buddy.bdd_and(guard, lit)
+            letter = buddy.bdd_and(letter, lit)
+        return letter
+
+    def visits(self, edge):
+        return self.coverage.edges.get(edge, 0)
+
+    def target(self, state):
+        """Return the least visited out-edge of state, breaking ties by how little
+        the out-edges of its destination were visited and then randomly."""
+
+        def score(edge):
+            _, dst, number = edge
+            ahead = min((self.visits(e[2]) for e in self.succ[dst]), default=0)
+            return (self.visits(number), ahead, self.rng.random())
+
+        return min(self.succ[state], key=score)
+
+    def walk(self):
+        """Run one random walk and return its steps as (src, values, dst) tuples.
+
+        The walk stops at the first (state, assignment) pair it already took: the
+        run then repeats, and loop is set to the index of the first occurrence, so
+        that steps[loop:] is the cycle of a real lasso. Otherwise (bound reached or
+        no edge enabled) loop is None. The numbers of the edges it took are kept in
+        walked.
+        """
+        steps = []
+        seen = {}
+        self.loop = None
+        self.walked = []
+        state = self.system.get_init_state_number()
+        for i in range(self.bound):
+            if self.driver == "coverage" and self.succ[state]:
+                cond = self.target(state)[0]
+                letter = self.pick_inputs(buddy.bdd_exist(cond, self.output_cube))
+            else:
+                letter = self.pick_inputs(buddy.bddtrue)
+
+            enabled = [
+                edge
+                for edge in self.succ[state]
+                if buddy.bdd_and(edge[0], letter) != buddy.bddfalse
+            ]
+            if not enabled:
+                break
+            if self.nondet == "first":
+                cond, dst, number = enabled[0]
+            else:
+                cond, dst, number = self.rng.choice(enabled)
+
+            values = self.pick(buddy.bdd_and(cond, letter))
+            key = (state, tuple(values))
+            if key in seen:
+                self.loop = seen[key]
+                break
+            seen[key] = i
+
+            self.coverage.visit(number)
+            self.walked.append(number)
+            steps.append((state, values, dst))
+            state = dst
+        return steps
+
+    def format_word(self, steps, loop=None):
+        """Render steps as a Spot word, e.g. ``a&!b;cycle{!a&b;a&b}`` for a lasso
+        looping back to step loop, or ``a&!b;!a&b;cycle{1}`` without one."""
+        letters = [
+            "&".join(ap if value else f"!{ap}" for ap, value in zip(self.aps, values))
+            for _, values, _ in steps
+        ]
+        if loop is None:
+            return ";".join(letters + ["cycle{1}"])
+        cycle = "cycle{" + ";".join(letters[loop:]) + "}"
+        return ";".join(letters[:loop] + [cycle])
+
+    def format_transcript(self, steps):
+        """Render steps like the cleaned hoax output the dataset builder reads."""
+        lines = []
+        for src, values, dst in steps:
+            present = [ap for ap, value in zip(self.aps, values) if value]
+            if present:
+                valuation = "{" + ", ".join(f"'{ap}'" for ap in present) + "}"
+            else:
+                valuation = make_replacement(self.aps)
+            lines.append(f"0: ({src}, {valuation}, {dst})")
+        return "\n".join(lines)
+
+    def as_word(self, steps, loop=None):
+        """Return the steps as a spot.twa_word sharing the system's bdd_dict."""
+        return spot.parse_word(self.format_word(steps, loop), self.system.get_dict())
+
+    def sample(self, n):
+        """Yield n (word, transcript) pairs for the loaded system."""
+        for _ in range(n):
+            steps = self.walk()
+            yield self.format_word(steps, self.loop), self.format_transcript(steps)
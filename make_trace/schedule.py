@@ -0,0 +1,264 @@
+"""This module schedules the (spec, num_run) tasks of a parallel job over a fixed set
+of long-lived worker processes. Each spec is pinned to a home worker that keeps its
+system warm, tasks are dispatched heaviest first, idle workers steal from other
+specs, each task gets its own (adaptive) timeout, and failed tasks are retried
+instead of cancelling the remaining runs of their spec."""
+
+import logging
+import queue
+import random
+import time
+from multiprocessing import Process, Queue
+
+from . import cache
+
+logger = logging.getLogger(__name__)
+
+# A spec's first attempts get this multiple of its slowest successful run as
+# timeout, but never less than MIN_TIMEOUT seconds.
+ADAPT_FACTOR = 4
+MIN_TIMEOUT = 10
+# A worker is only killed once it overran its cooperative timeout (see
+# cause.Deadline) by this factor plus a grace period.
+HARD_FACTOR = 2
+HARD_GRACE = 30
+
+
+class Task:
+    """One run of a spec, with its attempt count, the timeout of its next attempt
+    and the sampling seed all of its attempts share."""
+
+    def __init__(self, tlsf_file, num_run):
+        self.tlsf_file = tlsf_file
+        self.num_run = num_run
+        self.attempts = 0
+        self.timeout = None
+        self.seed = None
+
+
+def worker_loop(run, tasks, results, worker_id):
+    """Runs the tasks sent to this worker until it receives None, reporting
+    (worker_id, token, result, error, synthesis failed, wall time) for each."""
+    while True:
+        item = tasks.get()
+        if item is None:
+            return
+        token, tlsf_file, num_run, timeout, seed = item
+        start = time.monotonic()
+        failed = False
+        try:
+            result, error = run(tlsf_file, num_run, timeout, seed), None
+        except cache.SynthesisFailed as e:
+            result, error, failed = None, str(e), True
+        except Exception as e:
+            result, error = None, str(e)
+        wall = time.monotonic() - start
+        results.put((worker_id, token, result, error, failed, wall))
+
+
+class Scheduler:
+    """Runs tasks on n_jobs workers, calling run(tlsf_file, num_run, timeout, seed)
+    in the worker for each.
+
+    - Cost is estimated from the cached system size (cache.peek); specs that are
+      not cached yet count as heaviest, but only one of their tasks runs until the
+      first one has synthesized (and cached) the system.
+    - Every spec is pinned to the worker that ran its first task, which keeps the
+      parsed system and its distance products in memory (see cache._loaded and
+      cause.Synthesizer). An idle worker takes the heaviest pending task of its
+      own or of a not yet pinned spec, and only steals the heaviest task of
+      another spec if it has none, so cheap specs fill in around slow ones
+      instead of queueing behind them.
+    - Once a spec has a successful run, its timeout adapts to ADAPT_FACTOR times
+      its slowest one (capped at timeout).
+    - A task that fails or times out is retried up to retries times with twice the
+      timeout (capped at timeout) and the same seed, so a retry samples the same
+      trace; a spec is only given up after max_spec_failures of its tasks ran
+      out of retries. A spec whose synthesis fails (cache.SynthesisFailed) is
+      given up at once. A worker that dies is replaced and its task retried.
+    """
+
+    def __init__(self, run, n_jobs, timeout=300, retries=2, max_spec_failures=3):
+        self.run_task = run
+        self.n_jobs = n_jobs
+        self.timeout = timeout
+        self.retries = retries
+        self.max_spec_failures = max_spec_failures
+
+        self.results = Queue()
+        # worker id -> (process, task queue)
+        self.workers = {}
+        # worker id -> (task, start time, token)
+        self.running = {}
+        self.tokens = 0
+
+        self.costs = {}
+        self.durations = {}
+        self.failures = {}
+        self.in_flight = {}
+        # spec -> id of the worker it is pinned to
+        self.home = {}
+
+    def spawn(self, worker_id):
+        tasks = Queue()
+        process = Process(
+            target=worker_loop, args=(self.run_task, tasks, self.results, worker_id)
+        )
+        process.start()
+        self.workers[worker_id] = (process, tasks)
+
+    def cost(self, tlsf_file):
+        """Returns the estimated cost of a run of the spec (its number of edges)."""
+        if tlsf_file not in self.costs:
+            meta = cache.peek(tlsf_file)
+            self.costs[tlsf_file] = meta["edges"] if meta else float("inf")
+        return self.costs[tlsf_file]
+
+    def first_timeout(self, tlsf_file):
+        durations = self.durations.get(tlsf_file)
+        if not durations:
+            return self.timeout
+        return min(self.timeout, max(MIN_TIMEOUT, ADAPT_FACTOR * max(durations)))
+
+    def next_task(self, pending, worker_id):
+        """Removes and returns the heaviest dispatchable task for the worker,
+        preferring its own specs over stealing, or None."""
+        own = stolen = None
+        for task in pending:
+            cost = self.cost(task.tlsf_file)
+            if cost == float("inf") and self.in_flight.get(task.tlsf_file):
+                continue
+            if self.home.get(task.tlsf_file, worker_id) == worker_id:
+                if own is None or cost > self.cost(own.tlsf_file):
+                    own = task
+            elif stolen is None or cost > self.cost(stolen.tlsf_file):
+                stolen = task
+        best = own or stolen
+        if best is not None:
+            pending.remove(best)
+            self.home.setdefault(best.tlsf_file, worker_id)
+        return best
+
+    def dispatch(self, worker_id, task):
+        task.attempts += 1
+        if task.timeout is None:
+            task.timeout = self.first_timeout(task.tlsf_file)
+        if task.seed is None:
+            task.seed = random.randrange(2**32)
+        self.in_flight[task.tlsf_file] = self.in_flight.get(task.tlsf_file, 0) + 1
+        self.tokens += 1
+        self.running[worker_id] = (task, time.monotonic(), self.tokens)
+        self.workers[worker_id][1].put(
+            (self.tokens, task.tlsf_file, task.num_run, task.timeout, task.seed)
+        )
+
+    def record(self, task, result, error):
+        return {
+            "file": task.tlsf_file,
+            "num_run": task.num_run,
+            "attempts": task.attempts,
+            "result": result,
+            "error": error,
+        }
+
+    def complete(self, worker_id, result, error, wall, pending, emit, failed=False):
+        """Handles the outcome of the task of a worker: emits it, or queues a
+        retry. failed marks a synthesis failure, which gives up the spec."""
+        task, _, _ = self.running.pop(worker_id)
+        spec = task.tlsf_file
+        self.in_flight[spec] -= 1
+        # The run may have filled the cache, so look the cost up again.
+        if self.costs.get(spec) == float("inf"):
+            del self.costs[spec]
+
+        timed_out = result is not None and result.get("timed_out")
+        if error is None and not timed_out:
+            self.durations.setdefault(spec, []).append(wall)
+            emit(self.record(task, result, None))
+            return
+
+        if task.attempts <= self.retries and not failed:
+            logger.warning(
+                f"Retrying {spec} run {task.num_run} (attempt {task.attempts + 1}):"
+                f" {error or 'timed out'}"
+            )
+            task.timeout = min(task.timeout * 2, self.timeout)
+            pending.append(task)
+            return
+
+        # Out of retries: keep the partial result of a timed-out run.
+        emit(self.record(task, result, error))
+        self.failures[spec] = self.failures.get(spec, 0) + 1
+        if failed:
+            self.failures[spec] = max(self.failures[spec], self.max_spec_failures)
+        if self.failures[spec] >= self.max_spec_failures:
+            logger.error(f"Giving up on {spec} after {self.failures[spec]} failures")
+            for other in [t for t in pending if t.tlsf_file == spec]:
+                pending.remove(other)
+                emit(self.record(other, None, "Cancelled"))
+
+    def reap(self, pending, emit):
+        """Replaces workers that died, and kills and replaces workers whose task
+        overran its hard deadline."""
+        now = time.monotonic()
+        for worker_id, (process, _) in list(self.workers.items()):
+            if worker_id in self.running or process.is_alive():
+                continue
+            process.join()
+            self.spawn(worker_id)
+        for worker_id, (task, start, _) in list(self.running.items()):
+            process, _ = self.workers[worker_id]
+            if not process.is_alive():
+                error = f"Worker died (exit code {process.exitcode})"
+            elif now - start > task.timeout * HARD_FACTOR + HARD_GRACE:
+                process.terminate()
+                error = f"Killed after {now - start:.0f}s"
+            else:
+                continue
+            process.join()
+            del self.workers[worker_id]
+            self.spawn(worker_id)
+            self.complete(worker_id, None, error, now - start, pending, emit)
+
+    def run(self, tasks, emit):
+        """Runs all tasks, calling emit(record) once per task with its final
+        outcome."""
+        pending = list(tasks)
+        for worker_id in range(self.n_jobs):
+            self.spawn(worker_id)
+
+        try:
+            while pending or self.running:
+                for worker_id in self.workers:
+                    if worker_id in self.running:
+                        continue
+                    task = self.next_task(pending, worker_id)
+                    if task is None:
+                        break
+                    self.dispatch(worker_id, task)
+
+                try:
+                    item = self.results.get(timeout=1)
+                except queue.Empty:
+                    pass
+                else:
+                    worker_id, token, result, error, failed, wall = item
+                    # Ignore late results of workers that were killed meanwhile.
+                    if self.running.get(worker_id, (None, None, None))[2] == token:
+                        self.complete(
+                            worker_id, result, error, wall, pending, emit, failed
+                        )
+                self.reap(pending, emit)
+        finally:
+            self.shutdown()
+
+    def shutdown(self):
+        for process, tasks in self.workers.values():
+            if self.running:
+                process.terminate()
+            else:
+                tasks.put(None)
+        for process, _ in self.workers.values():
+            process.join()
+        self.workers = {}
+        self.running = {}
@@ -0,0 +1,242 @@
+"""This module stores pipeline records as batched zstd chunks, keeping each distinct
+system HOA only once in a side table.
+
+A data file is a sequence of independent zstd frames, one per chunk of JSONL
+records, so it stays readable with ``zstd -dc``. Records reference their system by
+``result["hoa_key"]`` (the sha256 of the HOA); ``<data file>.hoa`` is a JSONL table of
+``{"key", "hoa"}`` entries. A chunk is only written after the table entries it
+refers to are on disk, and a crash loses at most the chunk being written.
+
+For random access, ``RecordFile`` memory-maps a data file (chunked or plain JSONL)
+together with a record index (``<data file>.idx.npy``, plus ``.frames.npy`` for
+chunked files) that is built on first use.
+"""
+
+import hashlib
+import json
+import mmap
+import os
+import time
+from pathlib import Path
+
+import numpy as np
+import zstandard
+
+# A chunk is written once it holds this many records or is this many seconds old.
+CHUNK_RECORDS = 256
+CHUNK_SECONDS = 10
+
+
+def hoa_table(path):
+    """Returns the path of the HOA side table of a data file."""
+    return Path(f"{path}.hoa")
+
+
+class ChunkWriter:
+    """Batches records into compressed chunks and deduplicates their system HOA."""
+
+    def __init__(self, path, level=3):
+        self.data = open(path, "wb")
+        self.hoa = open(hoa_table(path), "w", encoding="utf-8")
+        self.known = set()
+        self.batch = []
+        self.started = time.monotonic()
+        self.compressor = zstandard.ZstdCompressor(level=level, write_checksum=True)
+
+    def add(self, record):
+        result = record.get("result")
+        if result and "hoa" in result:
+            key = hashlib.sha256(result["hoa"].encode("utf-8")).hexdigest()
+            if key not in self.known:
+                self.hoa.write(json.dumps({"key": key, "hoa": result["hoa"]}) + "\n")
+                self.known.add(key)
+            result = {k: v for k, v in result.items() if k != "hoa"}
+            result["hoa_key"] = key
+            record = dict(record, result=result)
+
+        self.batch.append(json.dumps(record))
+        if (
+            len(self.batch) >= CHUNK_RECORDS
+            or time.monotonic() - self.started >= CHUNK_SECONDS
+        ):
+            self.flush()
+
+    def flush(self):
+        """Writes the pending records as one chunk and syncs it to disk."""
+        if self.batch:
+            # The side table must be durable before a chunk refers to it.
+            self.hoa.flush()
+            os.fsync(self.hoa.fileno())
+
+            chunk = ("\n".join(self.batch) + "\n").encode("utf-8")
+            self.data.write(self.compressor.compress(chunk))
+            self.data.flush()
+            os.fsync(self.data.fileno())
+            self.batch = []
+        self.started = time.monotonic()
+
+    def close(self):
+        self.flush()
+        self.data.close()
+        self.hoa.close()
+
+
+def frames(f, block_size=1 << 20):
+    """Yields (offset, size, data) for each chunk of a data file, dropping a
+    truncated last chunk."""
+    dctx = zstandard.ZstdDecompressor()
+    buffer = b""
+    consumed = 0
+    while True:
+        frame = dctx.decompressobj()
+        start = consumed
+        parts = []
+        while not frame.eof:
+            if not buffer:
+                buffer = f.read(block_size)
+                if not buffer:
+                    return
+            size = len(buffer)
+            parts.append(frame.decompress(buffer))
+            buffer = frame.unused_data
+            consumed += size - len(buffer)
+        yield start, consumed - start, b"".join(parts)
+
+
+def load_hoas(path):
+    """Returns the HOA side table of a data file as a dict from key to HOA."""
+    hoas = {}
+    with open(hoa_table(path), "r", encoding="utf-8") as f:
+        for line in f:
+            # A crash may leave a partial last entry that no chunk refers to.
+            if line.endswith("\n"):
+                entry = json.loads(line)
+                hoas[entry["key"]] = entry["hoa"]
+    return hoas
+
+
+def read_records(path):
+    """Yields the records of a data file with their HOA restored.
+
+    Plain JSONL files (as written before chunked output) are read line by line.
+    """
+    if not str(path).endswith(".zst"):
+        with open(path, "r", encoding="utf-8") as f:
+            for line in f:
+                yield json.loads(line)
+        return
+
+    hoas = load_hoas(path)
+    with open(path, "rb") as f:
+        for _, _, chunk in frames(f):
+            for line in chunk.decode("utf-8").splitlines():
+                record = json.loads(line)
+                result = record.get("result")
+                if result and "hoa_key" in result:
+                    result["hoa"] = hoas[result.pop("hoa_key")]
+                yield record
+
+
+def index_paths(path):
+    """Returns the paths of the record and chunk index of a data file."""
+    return Path(f"{path}.idx.npy"), Path(f"{path}.frames.npy")
+
+
+def lines(data):
+    """Yields (start, end, line) for each line of data."""
+    start = 0
+    while start < len(data):
+        end = data.find(b"\n", start)
+        end = len(data) if end < 0 else end
+        yield start, end, data[start:end]
+        start = end + 1
+
+
+def build_index(path):
+    """Scans a data file once and writes its index.
+
+    Each record gets a (chunk, start, end, ok) row: the byte range of its line,
+    within the decompressed chunk for chunked files or within the file (chunk -1)
+    for plain JSONL, and whether it ran without error.
+    """
+    records, chunk_rows = [], []
+
+    def add(frame, start, end, line):
+        if line.strip():
+            ok = json.loads(line).get("error") is None
+            records.append((frame, start, end, ok))
+
+    with open(path, "rb") as f:
+        if str(path).endswith(".zst"):
+            for k, (offset, size, data) in enumerate(frames(f)):
+                chunk_rows.append((offset, size))
+                for start, end, line in lines(data):
+                    add(k, start, end, line)
+        else:
+            offset = 0
+            for line in f:
+                add(-1, offset, offset + len(line.rstrip(b"\n")), line)
+                offset += len(line)
+
+    idx_path, frames_path = index_paths(path)
+    np.save(idx_path, np.array(records, dtype=np.int64).reshape(-1, 4))
+    np.save(frames_path, np.array(chunk_rows, dtype=np.int64).reshape(-1, 2))
+
+
+class RecordFile:
+    """Random access to the records of a data file without loading it.
+
+    The data file and its index are memory-mapped, and only the lines (or, for
+    chunked files, the chunks) of accessed records are parsed, with the last
+    decompressed chunk kept for sequential access. The HOA side table is loaded
+    once. Mappings are opened lazily and dropped on pickling, so that every
+    DataLoader worker maps the file itself.
+    """
+
+    def __init__(self, path):
+        self.path = str(path)
+        idx_path, frames_path = index_paths(path)
+        if (
+            not idx_path.exists()
+            or idx_path.stat().st_mtime < Path(path).stat().st_mtime
+        ):
+            build_index(path)
+        self.index = np.load(idx_path, mmap_mode="r")
+        self.chunk_rows = np.load(frames_path)
+        self.chunked = self.path.endswith(".zst")
+        self.hoas = load_hoas(path) if self.chunked else {}
+        self.mm = None
+        self.chunk = (None, None)
+
+    def __getstate__(self):
+        state = dict(self.__dict__)
+        state["mm"] = None
+        state["chunk"] = (None, None)
+        return state
+
+    def __len__(self):
+        return len(self.index)
+
+    def ok(self):
+        """Returns the indices of the records that ran without error."""
+        return np.flatnonzero(self.index[:, 3])
+
+    def data(self, frame):
+        if self.chunk[0] != frame:
+            offset, size = self.chunk_rows[frame]
+            raw = self.mm[offset : offset + size]
+            self.chunk = (frame, zstandard.ZstdDecompressor().decompress(raw))
+        return self.chunk[1]
+
+    def __getitem__(self, i):
+        if self.mm is None:
+            with open(self.path, "rb") as f:
+                self.mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+
+        frame, start, end, _ = (int(v) for v in self.index[i])
+        source = self.mm if frame < 0 else self.data(frame)
+        record = json.loads(source[start:end])
+        result = record.get("result")
+        if result and "hoa_key" in result:
+            result["hoa"] = self.hoas[result.pop("hoa_key")]
+        return record
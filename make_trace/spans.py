@@ -0,0 +1,71 @@
+"""This module records per-stage spans (wall time, peak RSS and the size of the
+stage's intermediate automaton) for the pipeline and cause synthesis."""
+
+import resource
+import time
+from contextlib import contextmanager
+
+
+class Span(dict):
+    """A single stage measurement, stored as a plain (JSON-serializable) dict."""
+
+    def automaton(self, automaton):
+        """Records the size of the stage's intermediate automaton and returns it."""
+        self["states"] = automaton.num_states()
+        self["edges"] = automaton.num_edges()
+        return automaton
+
+
+class Recorder:
+    """Collects the spans of one pipeline run.
+
+    Spans recorded while a label is set (e.g. the effect under synthesis) carry
+    that label, so that the sub-steps of many effects can be told apart.
+    """
+
+    def __init__(self):
+        self.spans = []
+        self.label = None
+
+    @contextmanager
+    def span(self, stage):
+        span = Span(stage=stage)
+        if self.label is not None:
+            span["label"] = self.label
+        start = time.perf_counter()
+        try:
+            yield span
+        finally:
+            span["wall"] = time.perf_counter() - start
+            # ru_maxrss is the peak of the whole process so far (KiB on Linux).
+            span["peak_rss_kb"] = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+            self.spans.append(span)
+
+
+def percentile(values, q):
+    """Returns the q-th percentile (0 <= q <= 100) of a sorted list."""
+    if not values:
+        return None
+    return values[min(len(values) - 1, int(q / 100 * len(values)))]
+
+
+def summarize(spans):
+    """Aggregates spans by stage into a per-stage summary report."""
+    stages = {}
+    for span in spans:
+        stages.setdefault(span["stage"], []).append(span)
+
+    summary = {}
+    for stage, group in stages.items():
+        walls = sorted(s["wall"] for s in group)
+        summary[stage] = {
+            "count": len(group),
+            "total_wall": sum(walls),
+            "p50_wall": percentile(walls, 50),
+            "p95_wall": percentile(walls, 95),
+            "max_wall": walls[-1],
+            "max_peak_rss_kb": max(s["peak_rss_kb"] for s in group),
+            "max_states": max((s.get("states", 0) for s in group), default=0),
+            "max_edges": max((s.get("edges", 0) for s in group), default=0),
+        }
+    return summary
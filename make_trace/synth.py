@@ -0,0 +1,107 @@
+"""This module runs reactive synthesis through Spot's synthesis API instead of
+spawning one ltlsynt process per run."""
+
+import logging
+import multiprocessing
+import subprocess
+import time
+from pathlib import Path
+
+import spot
+
+logger = logging.getLogger(__name__)
+
+
+def overwrite_args(params: dict = None):
+    """Return the syfco arguments overriding the given TLSF parameters."""
+    args = []
+    for name, value in (params or {}).items():
+        args += ["-op", f"{name}={value}"]
+    return args
+
+
+def tlsf_formula(tlsf_file: Path, timeout: int = 300, params: dict = None):
+    """Translate a TLSF file into a single LTL formula via syfco.
+
+    Uses the same syfco invocation as ``ltlsynt --tlsf``; params overrides GLOBAL
+    PARAMETERS of the spec (e.g. ``{"n": 6}``).
+    """
+    cmd = ["syfco", "-f", "ltlxba", "-m", "fully", *overwrite_args(params)]
+    cmd.append(str(tlsf_file))
+    logger.debug(f"Running command: {' '.join(cmd)}")
+    res = subprocess.run(
+        cmd, capture_output=True, text=True, timeout=timeout, check=True
+    )
+    return res.stdout.strip()
+
+
+def synthesize_mealy(formula: str, outputs: list):
+    """Synthesize a Mealy machine for the given formula and output APs.
+
+    Mirrors ltlsynt's default configuration (LAR game, bisimulation-based
+    minimization) and returns the machine as a twa_graph with its synthesis outputs
+    set, so that ``spot.get_synthesis_output_aps`` works on it.
+    """
+    gi = spot.synthesis_info()
+    gi.s = spot.synthesis_info.algo_LAR
+
+    game = spot.ltl_to_game(spot.formula(formula), list(outputs), gi)
+    if not spot.solve_game(game):
+        raise RuntimeError("Specification is unrealizable")
+
+    mealy = spot.solved_game_to_mealy(game, gi)
+    spot.simplify_mealy_here(mealy, gi.minimize_lvl, False)
+    mealy.merge_edges()
+    return mealy
+
+
+def _synthesize_child(conn, formula, outputs):
+    """Synthesizes in a forked child and sends back ("ok", HOA) or ("error", msg)."""
+    try:
+        conn.send(("ok", synthesize_mealy(formula, outputs).to_str("hoa", "1.1")))
+    except Exception as e:
+        conn.send(("error", f"{type(e).__name__}: {e}"))
+    finally:
+        conn.close()
+
+
+def synthesize_bounded(formula: str, outputs: list, timeout: float):
+    """Run synthesize_mealy in a forked child that is killed after timeout seconds.
+
+    Game solving is a single Spot call, which no cause.Deadline can stop, so it
+    gets its own process, as ltlsynt did. The machine comes back as HOA (whose
+    controllable-AP header keeps the synthesis outputs) and is parsed in this
+    process. Raises
+    subprocess.TimeoutExpired on timeout and RuntimeError if synthesis fails.
+    """
+    ctx = multiprocessing.get_context("fork")
+    receiver, sender = ctx.Pipe(duplex=False)
+    child = ctx.Process(target=_synthesize_child, args=(sender, formula, outputs))
+    child.start()
+    sender.close()
+    try:
+        if not receiver.poll(timeout):
+            raise subprocess.TimeoutExpired("synthesize_mealy", timeout)
+        status, payload = receiver.recv()
+    except EOFError:
+        raise RuntimeError(f"Synthesis process died (exit code {child.exitcode})")
+    finally:
+        if child.is_alive():
+            child.kill()
+        child.join()
+        receiver.close()
+
+    if status != "ok":
+        raise RuntimeError(payload)
+    return spot.automaton(payload)
+
+
+def synthesize_tlsf(
+    tlsf_file: Path, outputs: list, timeout: int = 300, params: dict = None
+):
+    """Synthesize the Mealy machine of a TLSF file, with syfco and Spot's synthesis
+    together bounded by timeout seconds."""
+    start = time.monotonic()
+    formula = tlsf_formula(tlsf_file, timeout, params)
+    remaining = max(0, timeout - (time.monotonic() - start))
+    return synthesize_bounded(formula, outputs, remaining)
@@ -0,0 +1,55 @@
+"""This module memoizes LTL-to-automaton translations, so that every distinct effect
+and distance metric is translated once per process and, with
+``TEMPO_BENCH_DISK_TRANSLATIONS=1``, once per cache directory."""
+
+import hashlib
+import os
+
+import spot
+
+from . import cache
+
+# Translations are additionally stored below the cache directory if this is set.
+ON_DISK = os.environ.get("TEMPO_BENCH_DISK_TRANSLATIONS", "0") not in ("", "0")
+
+# Automata already translated by this process, keyed by (formula, options).
+_translated = {}
+
+
+def disk_path(formula: str, options):
+    """Return the cache file of a translation (keyed by the Spot version, too)."""
+    text = "\n".join([spot.version(), formula, *options])
+    digest = hashlib.sha256(text.encode("utf-8")).hexdigest()
+    return cache.CACHE_DIR / "translations" / f"{digest}.hoa"
+
+
+def translate(formula, *options):
+    """Return the automaton of an LTL formula (a string or spot.formula), passed
+    through spot.postprocess with the given options if there are any.
+
+    Translations are keyed by the formula as Spot prints it and by the options. The
+    returned automaton is shared by all callers and must not be modified; the
+    synthesis stages only ever read it or copy it (e.g. through auto.add_suffix).
+    """
+    if isinstance(formula, str):
+        formula = spot.formula(formula)
+    key = (str(formula), options)
+    if key in _translated:
+        return _translated[key]
+
+    path = disk_path(*key) if ON_DISK else None
+    if path is not None and path.exists():
+        automaton = spot.automaton(str(path))
+    else:
+        automaton = spot.translate(formula)
+        if options:
+            automaton = spot.postprocess(automaton, *options)
+        if path is not None:
+            # Published atomically, like cache entries (see cache._fill).
+            path.parent.mkdir(parents=True, exist_ok=True)
+            tmp = path.with_suffix(f".{os.getpid()}.tmp")
+            tmp.write_text(automaton.to_str("hoa"))
+            os.replace(tmp, path)
+
+    _translated[key] = automaton
+    return automaton
@@ -1,328 +1,421 @@
 #!/usr/bin/env python3
-"""Grid-based visualization for arbiter trace.
+"""Grid-based visualization of traces.
 
-Renders the trace as a sequence of frames showing signal states and grant status.
+Renders a trace as a sequence of frames with one cell per atomic proposition, inputs
+on top and outputs below. Traces are read from a plain trace file or directly from a
+run_parallel data file (JSONL, chunked or not), taking the APs of each record from
+result["aps"]. Many traces can be rendered in parallel into contact sheets or
+animations, and the same grid layout can be exported for game_visualization.html.
 """
 
+import json
+import math
 import re
+import sys
+from multiprocessing import Pool
 from pathlib import Path
 
-import matplotlib.patches as patches
-import matplotlib.pyplot as plt
+import matplotlib
+
+matplotlib.use("Agg")
+
+import matplotlib.patches as patches  # noqa: E402
+import matplotlib.pyplot as plt  # noqa: E402
+from matplotlib.animation import FuncAnimation, PillowWriter  # noqa: E402
+
+# The record reader lives in make_trace, next to this directory.
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+
+# Cells per grid row, unless given.
+MAX_COLUMNS = 8
+
+COLORS = {
+    "input_on": "#2E7D32",  # Green for inputs that are set
+    "input_off": "#B71C1C",  # Red for inputs that are not
+    "output_on": "#FFD700",  # Gold for outputs that are set
+    "output_off": "#9E9E9E",  # Gray for outputs that are not
+    "unknown": "#E0E0E0",  # Light gray for APs the letter leaves open
+    "background": "#F5F5F5",  # Light gray background
+    "grid": "#BDBDBD",  # Grid lines
+}
+
+
+def split_lasso(trace):
+    """Splits a Spot word ``a;b;cycle{c;d}`` into its prefix and cycle letters."""
+    trace = trace.strip()
+    match = re.search(r"cycle\{(.*)\}$", trace)
+    cycle = match.group(1) if match else ""
+    prefix = trace[: match.start()] if match else trace
+    letters = [s.strip() for s in prefix.split(";") if s.strip()]
+    return letters, [s.strip() for s in cycle.split(";") if s.strip()]
+
+
+def parse_frame(frame_str, aps):
+    """Parses a letter like ``!g_0&s_0`` into a dict from AP to True, False or None
+    (not fixed by the letter)."""
+    state = {ap: None for ap in aps}
+    for literal in frame_str.strip("() ").split("&"):
+        literal = literal.strip(" ()")
+        if literal.startswith("!") and literal[1:] in state:
+            state[literal[1:]] = False
+        elif literal in state:
+            state[literal] = True
+    return state
+
+
+def trace_aps(trace):
+    """Returns the APs mentioned in a trace, in order of appearance."""
+    seen = {}
+    for name in re.findall(r"[A-Za-z_][A-Za-z0-9_]*", trace):
+        if name not in ("cycle", "true", "false"):
+            seen.setdefault(name, None)
+    return list(seen)
+
+
+def parse_frames(trace, aps):
+    """Returns the frames of the prefix and one pass through the cycle."""
+    prefix, cycle = split_lasso(trace)
+    return [parse_frame(letter, aps) for letter in prefix + cycle]
+
+
+def hoa_outputs(hoa, aps):
+    """Returns the controllable APs (outputs) declared in a system HOA."""
+    match = re.search(r"^controllable-AP:(.*)$", hoa or "", re.MULTILINE)
+    if not match:
+        return []
+    return [aps[int(i)] for i in match.group(1).split()]
+
+
+def grid_layout(aps, outputs, columns=None):
+    """Returns the cell of every AP as a list of {"ap", "row", "col", "kind"}: the
+    inputs fill the top rows and the outputs the rows below, in AP order."""
+    inputs = [ap for ap in aps if ap not in outputs]
+    outputs = [ap for ap in aps if ap in outputs]
+    columns = columns or max(1, min(MAX_COLUMNS, max(len(inputs), len(outputs))))
+    cells = []
+    row = 0
+    for kind, group in (("input", inputs), ("output", outputs)):
+        for k, ap in enumerate(group):
+            cells.append(
+                {"ap": ap, "row": row + k // columns, "col": k % columns, "kind": kind}
+            )
+        row += math.ceil(len(group) / columns)
+    return cells
 
-# import numpy as np
-from matplotlib.animation import FuncAnimation, PillowWriter
 
+def cell_color(kind, value):
+    if value is None:
+        return COLORS["unknown"]
+    return COLORS[f"{kind}_{'on' if value else 'off'}"]
 
-class ArbiterTraceVisualizer:
-    def __init__(self, trace_file, output_dir="output"):
-        self.trace_file = Path(trace_file)
-        self.output_dir = Path(output_dir)
-        self.output_dir.mkdir(exist_ok=True)
-
-        self.frames = []
-        self.parse_trace()
-
-        # Grid dimensions
-        self.grid_size = 3  # 3x3 grid
-        self.cell_size = 1.0
-
-        # Colors
-        self.colors = {
-            "signal_on": "#2E7D32",  # Green for signal on
-            "signal_off": "#B71C1C",  # Red for signal off
-            "grant_on": "#FFD700",  # Gold for grant on
-            "grant_off": "#9E9E9E",  # Gray for grant off
-            "background": "#F5F5F5",  # Light gray background
-            "grid": "#BDBDBD",  # Grid lines
-        }
-
-    def parse_trace(self):
-        """Parse the trace file to extract frames."""
-        with open(self.trace_file, "r") as f:
-            content = f.read().strip()
-
-        # Parse the trace format: !g_0&s_0;!g_0&s_0;...
-        # Extract the first line with actual trace data
-        for line in content.split("\n"):
-            if "&" in line and ";" in line:
-                # Remove any leading numbers and arrows
-                trace_data = re.sub(r"^[0-9→\s]+", "", line)
-                # Remove cycle information at the end
-                trace_data = re.sub(r";cycle\{[0-9]+\}$", "", trace_data)
-
-                # Split into individual frames
-                frame_strings = trace_data.split(";")
-
-                for frame_str in frame_strings:
-                    if frame_str.strip():
-                        frame = self.parse_frame(frame_str.strip())
-                        self.frames.append(frame)
-                break
-
-    def parse_frame(self, frame_str):
-        """Parse a single frame string like '!g_0&s_0' into state dict."""
-        state = {"s_0": False, "g_0": False}
-
-        # Split by & to get individual literals
-        literals = frame_str.split("&")
-
-        for literal in literals:
-            literal = literal.strip()
-            if literal.startswith("!"):
-                # Negated literal
-                var = literal[1:]
-                if var in state:
-                    state[var] = False
-            else:
-                # Positive literal
-                if literal in state:
-                    state[literal] = True
-
-        return state
-
-    def draw_frame(self, ax, frame_idx):
-        """Draw a single frame on the given axes."""
-        ax.clear()
-        ax.set_xlim(-0.5, self.grid_size - 0.5)
-        ax.set_ylim(-0.5, self.grid_size - 0.5)
-        ax.set_aspect("equal")
 
-        # Remove ticks
-        ax.set_xticks([])
-        ax.set_yticks([])
+class TraceVisualizer:
+    """Draws the frames of one trace on a grid that is built once.
 
-        # Set background
-        ax.set_facecolor(self.colors["background"])
+    Moving to another frame only recolors the cells whose AP changed value, and
+    update returns exactly those artists, so FuncAnimation can blit them.
+    """
 
-        # Get current frame state
-        if frame_idx < len(self.frames):
-            state = self.frames[frame_idx]
-        else:
-            state = {"s_0": False, "g_0": False}
+    def __init__(self, aps, outputs, frames, title="Trace", columns=None):
+        self.aps = list(aps)
+        self.frames = frames
+        self.title = title
+        self.layout = grid_layout(self.aps, outputs, columns)
+        self.fig = None
+        self.current = None
 
-        # Draw grid cells
-        # Top row: Signal indicator
-        signal_color = (
-            self.colors["signal_on"] if state["s_0"] else self.colors["signal_off"]
-        )
-        rect = patches.Rectangle(
-            (0.5, 1.5),
-            1,
-            1,
-            linewidth=2,
-            edgecolor=self.colors["grid"],
-            facecolor=signal_color,
-            alpha=0.8,
+    def figure(self):
+        """Builds the figure with one patch and label per AP."""
+        columns = max(c["col"] for c in self.layout) + 1 if self.layout else 1
+        rows = max(c["row"] for c in self.layout) + 1 if self.layout else 1
+        self.fig, ax = plt.subplots(
+            1, 1, figsize=(1.5 * columns + 1, 1.5 * rows + 1.5)
         )
-        ax.add_patch(rect)
-        ax.text(
-            1,
-            2,
-            "s_0",
-            ha="center",
-            va="center",
-            fontsize=14,
-            fontweight="bold",
-            color="white",
-        )
-
-        # Middle: Arrow indicating request/grant flow
-        if state["s_0"]:
-            arrow = patches.FancyArrowPatch(
-                (1, 1.4),
-                (1, 0.6),
-                connectionstyle="arc3",
-                arrowstyle="->",
-                mutation_scale=20,
-                color="black",
+        ax.set_xlim(-0.5, columns - 0.5)
+        ax.set_ylim(-1.5, rows - 0.5)
+        ax.set_aspect("equal")
+        ax.set_xticks([])
+        ax.set_yticks([])
+        ax.set_facecolor(COLORS["background"])
+        ax.set_title(self.title, fontsize=14, fontweight="bold")
+
+        self.cells = {}
+        for cell in self.layout:
+            x, y = cell["col"], rows - 1 - cell["row"]
+            rect = patches.Rectangle(
+                (x - 0.45, y - 0.45),
+                0.9,
+                0.9,
                 linewidth=2,
+                edgecolor=COLORS["grid"],
+                facecolor=cell_color(cell["kind"], None),
+                alpha=0.8,
             )
-            ax.add_patch(arrow)
-
-        # Bottom row: Grant indicator
-        grant_color = (
-            self.colors["grant_on"] if state["g_0"] else self.colors["grant_off"]
-        )
-        rect = patches.Rectangle(
-            (0.5, -0.5),
-            1,
-            1,
-            linewidth=2,
-            edgecolor=self.colors["grid"],
-            facecolor=grant_color,
-            alpha=0.8,
-        )
-        ax.add_patch(rect)
-        ax.text(
-            1,
-            0,
-            "g_0",
-            ha="center",
-            va="center",
-            fontsize=14,
-            fontweight="bold",
-            color="black" if state["g_0"] else "white",
-        )
-
-        # Add labels
-        ax.text(2.2, 2, "Signal", ha="left", va="center", fontsize=12)
-        ax.text(2.2, 0, "Grant", ha="left", va="center", fontsize=12)
-
-        # Add frame number and state info
-        ax.text(
-            1,
-            -1.2,
-            f"Frame {frame_idx + 1}/{len(self.frames)}",
-            ha="center",
-            va="center",
-            fontsize=11,
-        )
-
-        state_text = (
-            f"s_0={'ON' if state['s_0'] else 'OFF'},"
-            f"g_0={'ON' if state['g_0'] else 'OFF'}",
-        )
-        ax.text(
-            1, -1.5, state_text, ha="center", va="center", fontsize=10, style="italic"
-        )
-
-        # Add title
-        ax.text(
-            1,
-            2.8,
-            "Arbiter State",
-            ha="center",
-            va="center",
-            fontsize=16,
-            fontweight="bold",
+            ax.add_patch(rect)
+            text = ax.text(
+                x, y, cell["ap"], ha="center", va="center", fontsize=11, color="black"
+            )
+            self.cells[cell["ap"]] = (cell["kind"], rect, text)
+        self.caption = ax.text(
+            (columns - 1) / 2, -1, "", ha="center", va="center", fontsize=11
         )
+        self.current = {ap: None for ap in self.aps}
+        return self.fig
+
+    def update(self, frame_idx):
+        """Shows frame frame_idx and returns the artists that changed."""
+        if self.fig is None:
+            self.figure()
+        state = self.frames[frame_idx] if frame_idx < len(self.frames) else {}
+        changed = []
+        for ap, (kind, rect, text) in self.cells.items():
+            value = state.get(ap)
+            if value != self.current[ap]:
+                rect.set_facecolor(cell_color(kind, value))
+                text.set_color("white" if value and kind == "input" else "black")
+                self.current[ap] = value
+                changed.extend((rect, text))
+        self.caption.set_text(f"Frame {frame_idx + 1}/{len(self.frames)}")
+        changed.append(self.caption)
+        return changed
+
+    def save_frames(self, frames_dir):
+        """Saves every frame as an image, reusing one figure."""
+        frames_dir = Path(frames_dir)
+        frames_dir.mkdir(parents=True, exist_ok=True)
+        for idx in range(len(self.frames)):
+            self.update(idx)
+            self.fig.savefig(
+                frames_dir / f"frame_{idx:03d}.png", dpi=100, facecolor="white"
+            )
+        plt.close(self.fig)
+        self.fig = None
 
-    def save_frames(self):
-        """Save individual frames as images."""
-        frames_dir = self.output_dir / "frames"
-        frames_dir.mkdir(exist_ok=True)
-
-        for idx, frame in enumerate(self.frames):
-            fig, ax = plt.subplots(1, 1, figsize=(6, 6))
-            self.draw_frame(ax, idx)
-
-            filename = frames_dir / f"frame_{idx:03d}.png"
-            plt.savefig(filename, dpi=100, bbox_inches="tight", facecolor="white")
-            plt.close()
-
-        print(f"Saved {len(self.frames)} frames to {frames_dir}")
-
-    def create_animation(self, fps=2):
-        """Create an animated GIF of the trace."""
-        fig, ax = plt.subplots(1, 1, figsize=(6, 6))
+    def animate(self, path, fps=2):
+        """Saves the trace as an animated GIF."""
+        self.figure()
 
-        def update(frame_idx):
-            self.draw_frame(ax, frame_idx)
-            return ax.patches + ax.texts
+        def init():
+            return [a for _, rect, text in self.cells.values() for a in (rect, text)]
 
         anim = FuncAnimation(
-            fig, update, frames=len(self.frames), interval=1000 / fps, repeat=True
+            self.fig,
+            self.update,
+            frames=len(self.frames),
+            init_func=init,
+            interval=1000 / fps,
+            blit=True,
         )
+        anim.save(path, writer=PillowWriter(fps=fps))
+        plt.close(self.fig)
+        self.fig = None
 
-        # Save as GIF
-        gif_path = self.output_dir / "trace_animation.gif"
-        writer = PillowWriter(fps=fps)
-        anim.save(gif_path, writer=writer)
-        plt.close()
-
-        print(f"Saved animation to {gif_path}")
-
-    def create_grid_view(self, cols=3):
-        """Create a grid view showing multiple frames at once."""
-        n_frames = len(self.frames)
-        rows = (n_frames + cols - 1) // cols
-
-        fig, axes = plt.subplots(rows, cols, figsize=(cols * 4, rows * 4))
 
-        # Flatten axes array for easy iteration
-        if rows == 1:
-            axes = axes.reshape(1, -1)
-        if cols == 1:
-            axes = axes.reshape(-1, 1)
+class ArbiterTraceVisualizer(TraceVisualizer):
+    """Visualizes a single plain trace file, with the APs it mentions (outputs are
+    the APs starting with g, as in the arbiter specs)."""
 
-        for idx in range(rows * cols):
-            row = idx // cols
-            col = idx % cols
-            ax = axes[row, col]
-
-            if idx < n_frames:
-                self.draw_frame(ax, idx)
-            else:
-                ax.axis("off")
-
-        plt.suptitle("Arbiter Trace Sequence", fontsize=18, fontweight="bold")
-        plt.tight_layout()
+    def __init__(self, trace_file, output_dir="output"):
+        self.output_dir = Path(output_dir)
+        self.output_dir.mkdir(parents=True, exist_ok=True)
+        lines = Path(trace_file).read_text().splitlines()
+        trace = next((line for line in lines if line.strip()), "")
+        # Drop any leading numbers and arrows of annotated trace files.
+        trace = re.sub(r"^[0-9→\s]+", "", trace)
+        aps = trace_aps(trace)
+        outputs = [ap for ap in aps if ap.startswith("g")]
+        super().__init__(aps, outputs, parse_frames(trace, aps), "Arbiter State")
 
-        # Save grid view
-        grid_path = self.output_dir / "trace_grid.png"
-        plt.savefig(grid_path, dpi=150, bbox_inches="tight", facecolor="white")
-        plt.close()
+    def print_trace_summary(self):
+        print(trace_summary(self.aps, self.frames))
 
-        print(f"Saved grid view to {grid_path}")
 
-    def print_trace_summary(self):
-        """Print a summary of the trace."""
-        print("\n" + "=" * 50)
-        print("TRACE SUMMARY")
-        print("=" * 50)
-        print(f"Total frames: {len(self.frames)}")
-        print("\nFrame-by-frame states:")
-        print("-" * 30)
-
-        for idx, frame in enumerate(self.frames):
-            s_state = "ON " if frame["s_0"] else "OFF"
-            g_state = "ON " if frame["g_0"] else "OFF"
-            print(f"Frame {idx+1:2d}: Signal={s_state}  Grant={g_state}")
-
-        # Analyze patterns
-        print("\n" + "-" * 30)
-        print("PATTERN ANALYSIS:")
-
-        # Count state changes
-        signal_changes = 0
-        grant_changes = 0
-
-        for i in range(1, len(self.frames)):
-            if self.frames[i]["s_0"] != self.frames[i - 1]["s_0"]:
-                signal_changes += 1
-            if self.frames[i]["g_0"] != self.frames[i - 1]["g_0"]:
-                grant_changes += 1
-
-        print(f"Signal changes: {signal_changes}")
-        print(f"Grant changes: {grant_changes}")
-
-        # Check for grant-follows-signal pattern
-        grant_after_signal = 0
-        for i in range(len(self.frames) - 1):
-            if (
-                not self.frames[i]["s_0"] and self.frames[i + 1]["s_0"]
-            ):  # Signal turns on
-                # Look ahead for grant
-                for j in range(i + 1, min(i + 5, len(self.frames))):
-                    if self.frames[j]["g_0"]:
-                        grant_after_signal += 1
-                        break
-
-        print(f"Times grant followed signal change: {grant_after_signal}")
-        print("=" * 50 + "\n")
+def trace_summary(aps, frames):
+    """Returns a frame-by-frame table and the number of value changes per AP."""
+    lines = ["=" * 50, "TRACE SUMMARY", "=" * 50, f"Total frames: {len(frames)}"]
+    for idx, frame in enumerate(frames):
+        values = "  ".join(
+            f"{ap}={'?' if frame[ap] is None else 'ON ' if frame[ap] else 'OFF'}"
+            for ap in aps
+        )
+        lines.append(f"Frame {idx + 1:2d}: {values}")
+    lines.append("-" * 30)
+    for ap in aps:
+        changes = sum(frames[i][ap] != frames[i - 1][ap] for i in range(1, len(frames)))
+        lines.append(f"{ap} changes: {changes}")
+    return "\n".join(lines)
+
+
+def load_traces(data_file, limit=None, every=1):
+    """Reads the successful runs of a run_parallel data file as compact trace
+    descriptions {"name", "aps", "outputs", "frames", "trace", "causality",
+    "effects"}, taking every every-th run up to limit traces."""
+    from make_trace.sink import read_records
+
+    traces = []
+    ok = 0
+    for record in read_records(data_file):
+        result = record.get("result")
+        if record.get("error") is not None or not result:
+            continue
+        ok += 1
+        if (ok - 1) % every:
+            continue
+        aps = result["aps"]
+        traces.append(
+            {
+                "name": f"{Path(record['file']).stem} #{record['num_run']}",
+                "aps": aps,
+                "outputs": hoa_outputs(result.get("hoa"), aps),
+                "frames": parse_frames(result["trace"], aps),
+                "trace": result["trace"],
+                "causality": result.get("causality") or {},
+                "effects": result.get("effects", []),
+            }
+        )
+        if limit is not None and len(traces) >= limit:
+            break
+    return traces
+
+
+def draw_strip(ax, trace):
+    """Draws a trace as a compact AP x timestep strip."""
+    cells = grid_layout(trace["aps"], trace["outputs"], columns=1)
+    for t, frame in enumerate(trace["frames"]):
+        for y, cell in enumerate(reversed(cells)):
+            ax.add_patch(
+                patches.Rectangle(
+                    (t, y),
+                    1,
+                    1,
+                    facecolor=cell_color(cell["kind"], frame.get(cell["ap"])),
+                    edgecolor=COLORS["background"],
+                    linewidth=0.5,
+                )
+            )
+    ax.set_xlim(0, max(1, len(trace["frames"])))
+    ax.set_ylim(0, max(1, len(cells)))
+    ax.set_yticks([y + 0.5 for y in range(len(cells))])
+    ax.set_yticklabels([c["ap"] for c in reversed(cells)], fontsize=6)
+    ax.set_xticks([])
+    ax.set_title(trace["name"], fontsize=8)
+
+
+def render_sheet(args):
+    """Renders one contact sheet of traces into path (a Pool task)."""
+    traces, path, columns = args
+    rows = math.ceil(len(traces) / columns)
+    fig, axes = plt.subplots(
+        rows, columns, figsize=(columns * 4, rows * 2), squeeze=False
+    )
+    for idx, ax in enumerate(axes.flat):
+        if idx < len(traces):
+            draw_strip(ax, traces[idx])
+        else:
+            ax.axis("off")
+    fig.tight_layout()
+    fig.savefig(path, dpi=120, facecolor="white")
+    plt.close(fig)
+    return path
+
+
+def render_animation(args):
+    """Renders one trace as an animated GIF into path (a Pool task)."""
+    trace, path, fps = args
+    viz = TraceVisualizer(
+        trace["aps"], trace["outputs"], trace["frames"], trace["name"]
+    )
+    viz.animate(path, fps)
+    return path
+
+
+def render_all(
+    traces, output_dir, per_sheet=16, columns=4, videos=False, fps=2, n_jobs=1
+):
+    """Renders the traces into contact sheets of per_sheet traces (and, with videos
+    set, one GIF per trace) on n_jobs processes and returns the written paths."""
+    output_dir = Path(output_dir)
+    output_dir.mkdir(parents=True, exist_ok=True)
+    tasks = [
+        (
+            render_sheet,
+            (
+                traces[k : k + per_sheet],
+                output_dir / f"sheet_{k // per_sheet:04d}.png",
+                columns,
+            ),
+        )
+        for k in range(0, len(traces), per_sheet)
+    ]
+    if videos:
+        tasks += [
+            (render_animation, (trace, output_dir / f"trace_{k:05d}.gif", fps))
+            for k, trace in enumerate(traces)
+        ]
+    if n_jobs > 1:
+        with Pool(n_jobs) as pool:
+            return pool.map(run_task, tasks)
+    return [run_task(task) for task in tasks]
+
+
+def run_task(task):
+    function, args = task
+    return function(args)
+
+
+def effect_timestep(label):
+    """Returns the timestep of an effect label (``XXX g_0`` or ``X[3] ...``)."""
+    match = re.match(r"\s*X\[(\d+)\]", label)
+    if match:
+        return int(match.group(1))
+    return len(label) - len(label.lstrip("X"))
+
+
+def game_record(trace, columns=None):
+    """Returns the game_visualization.html description of a trace: its letters,
+    its first effect with the required inputs per timestep, and its grid layout."""
+    aps = trace["aps"]
+    letters = [
+        "&".join(ap if frame[ap] else f"!{ap}" for ap in aps if frame[ap] is not None)
+        for frame in trace["frames"]
+    ]
+    effect = next(iter(trace["causality"]), None)
+    layout = grid_layout(aps, trace["outputs"], columns)
+    return {
+        "name": trace["name"],
+        "targetEffect": effect or "",
+        "effectTimestep": effect_timestep(effect) if effect else len(letters) - 1,
+        "trace": letters,
+        "reasoning": trace["causality"].get(effect, {}),
+        "atomicPropositions": aps,
+        "outputs": trace["outputs"],
+        "columns": max(c["col"] for c in layout) + 1 if layout else 1,
+        "layout": layout,
+    }
+
+
+def export_games(traces, path, columns=None):
+    """Writes one game record per trace as JSONL, for streaming into
+    game_visualization.html."""
+    with open(path, "w", encoding="utf-8") as f:
+        for trace in traces:
+            f.write(json.dumps(game_record(trace, columns)) + "\n")
 
 
 def main():
     """Main function to run the visualizer."""
     import argparse
 
-    parser = argparse.ArgumentParser(description="Visualize arbiter trace")
+    parser = argparse.ArgumentParser(description="Visualize traces")
     parser.add_argument(
         "--trace",
         default="output/input.trace",
         help="Path to trace file (default: output/input.trace)",
     )
+    parser.add_argument(
+        "--data",
+        help="run_parallel data file (.jsonl or .jsonl.zst); replaces --trace",
+    )
     parser.add_argument(
         "--output",
         default="output/visualization",
@@ -337,8 +430,33 @@ def main():
     parser.add_argument(
         "--grid-cols",
         type=int,
-        default=3,
-        help="Number of columns in grid view (default: 3)",
+        default=4,
+        help="Number of traces per row of a contact sheet (default: 4)",
+    )
+    parser.add_argument(
+        "--limit",
+        type=int,
+        default=64,
+        help="Number of traces to render (default: 64)",
+    )
+    parser.add_argument(
+        "--every", type=int, default=1, help="Render every n-th run (default: 1)"
+    )
+    parser.add_argument(
+        "--per-sheet",
+        type=int,
+        default=16,
+        help="Traces per contact sheet (default: 16)",
+    )
+    parser.add_argument(
+        "--jobs", type=int, default=1, help="Rendering processes (default: 1)"
+    )
+    parser.add_argument(
+        "--videos", action="store_true", help="Also render one GIF per trace"
+    )
+    parser.add_argument(
+        "--export-game",
+        help="Write the traces as JSONL for game_visualization.html to this file",
     )
     parser.add_argument(
         "--no-frames", action="store_true", help="Skip saving individual frames"
@@ -352,6 +470,24 @@ def main():
 
     args = parser.parse_args()
 
+    if args.data:
+        traces = load_traces(args.data, args.limit, args.every)
+        print(f"Loaded {len(traces)} traces from {args.data}")
+        if args.export_game:
+            export_games(traces, args.export_game)
+            print(f"Saved game records to {args.export_game}")
+        paths = render_all(
+            traces,
+            args.output,
+            args.per_sheet,
+            args.grid_cols,
+            args.videos,
+            args.fps,
+            args.jobs,
+        )
+        print(f"Saved {len(paths)} files to {args.output}")
+        return
+
     # Create visualizer
     viz = ArbiterTraceVisualizer(args.trace, args.output)
 
@@ -361,15 +497,17 @@ def main():
     # Generate visualizations
     if not args.no_frames:
         print("\nGenerating individual frames...")
-        viz.save_frames()
+        viz.save_frames(viz.output_dir / "frames")
 
     if not args.no_animation:
         print("\nCreating animation...")
-        viz.create_animation(fps=args.fps)
+        viz.animate(viz.output_dir / "trace_animation.gif", fps=args.fps)
 
     if not args.no_grid:
         print("\nCreating grid view...")
-        viz.create_grid_view(cols=args.grid_cols)
+        trace = {"name": "Arbiter Trace Sequence", "aps": viz.aps, "frames": viz.frames}
+        trace["outputs"] = [c["ap"] for c in viz.layout if c["kind"] == "output"]
+        render_sheet(([trace], viz.output_dir / "trace_grid.png", 1))
 
     print("\nVisualization complete!")
 